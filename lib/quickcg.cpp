@@ -42,11 +42,30 @@ QuickCG can handle some things that standard C++ doesn't but that are commonly u
 
 #include <SDL/SDL.h>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <vector>
 #include <map>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define QUICKCG_SIMD_PNG //PNG unfiltering and pixel conversion with SSE2, and SSSE3 and AVX2 where the CPU has them
+#include <immintrin.h>
+#endif
 
 namespace QuickCG
 {
@@ -202,6 +221,59 @@ void drawBuffer(Uint32* buffer)
   }
 }
 
+//Draws a buffer of RGB565 pixels to the screen. The 5 and 6 bit channels are
+//widened by repeating their top bits, so white stays 0xFFFFFF
+void drawBuffer(const Uint16* buffer)
+{
+  for(int y = 0; y < h; y++)
+  {
+    Uint32* bufp = (Uint32*)((Uint8*)scr->pixels + y * scr->pitch);
+    const Uint16* in = buffer + y * w;
+    int x = 0;
+#ifdef __SSE2__
+    //8 pixels at a time: widen each channel in 16-bit lanes, then interleave blue-green with red-alpha
+    const __m128i mask5 = _mm_set1_epi16(0x1F), mask6 = _mm_set1_epi16(0x3F), alpha = _mm_set1_epi16(short(0xFF00));
+    for(; x + 8 <= w; x += 8)
+    {
+      __m128i p = _mm_loadu_si128((const __m128i*)(in + x));
+      __m128i r = _mm_srli_epi16(p, 11);
+      __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+      __m128i b = _mm_and_si128(p, mask5);
+      r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+      g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+      b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+      __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+      __m128i ar = _mm_or_si128(r, alpha);
+      _mm_storeu_si128((__m128i*)(bufp + x), _mm_unpacklo_epi16(bg, ar));
+      _mm_storeu_si128((__m128i*)(bufp + x + 4), _mm_unpackhi_epi16(bg, ar));
+    }
+#endif
+    for(; x < w; x++)
+    {
+      Uint32 p = in[x], r = p >> 11, g = (p >> 5) & 63, b = p & 31;
+      bufp[x] = 0xFF000000 | ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+    }
+  }
+}
+
+//Draws a buffer of 8-bit palette indices to the screen
+void drawBuffer(const Uint8* buffer, const Uint32* palette)
+{
+  for(int y = 0; y < h; y++)
+  {
+    Uint32* bufp = (Uint32*)((Uint8*)scr->pixels + y * scr->pitch);
+    const Uint8* in = buffer + y * w;
+    int x = 0;
+    //a lookup per pixel; unrolled so the loads of the next indices overlap the lookups
+    for(; x + 4 <= w; x += 4)
+    {
+      Uint32 a = palette[in[x]], b = palette[in[x + 1]], c = palette[in[x + 2]], d = palette[in[x + 3]];
+      bufp[x] = a; bufp[x + 1] = b; bufp[x + 2] = c; bufp[x + 3] = d;
+    }
+    for(; x < w; x++) bufp[x] = palette[in[x]];
+  }
+}
+
 void getScreenBuffer(std::vector<Uint32>& buffer)
 {
   Uint32* bufp;
@@ -226,6 +298,27 @@ bool onScreen(int x, int y)
   return (x >= 0 && y >= 0 && x < w && y < h);
 }
 
+Canvas::Canvas(Uint32* pixels, int width, int height)
+{
+  this->pixels = pixels;
+  this->width = width;
+  this->height = height;
+  this->pitch = width;
+}
+
+Canvas::Canvas(Uint32* pixels, int width, int height, int pitch)
+{
+  this->pixels = pixels;
+  this->width = width;
+  this->height = height;
+  this->pitch = pitch;
+}
+
+Canvas screenCanvas()
+{
+  return Canvas((Uint32*)scr->pixels, w, h, scr->pitch / 4);
+}
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -322,198 +415,225 @@ unsigned long getTicks()
 //2D SHAPES/////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
-
-//Fast horizontal line from (x1,y) to (x2,y), with rgb color
-bool horLine(int y, int x1, int x2, const ColorRGB& color)
+//Fills count pixels with the same color. Used for all the horizontal runs below.
+void fillSpan(Uint32* pixels, int count, Uint32 color)
 {
-  if(x2 < x1) {x1 += x2; x2 = x1 - x2; x1 -= x2;} //swap x1 and x2, x1 must be the leftmost endpoint
-  if(x2 < 0 || x1 >= w || y < 0 || y >= h) return 0; //no single point of the line is on screen
-  if(x1 < 0) x1 = 0; //clip
-  if(x2 >= w) x2 = w - 1; //clip
-
-  Uint32 colorSDL = SDL_MapRGB(scr->format, color.r, color.g, color.b);
-  Uint32* bufp;
-  bufp = (Uint32*)scr->pixels + y * scr->pitch / 4 + x1;
-  for(int x = x1; x <= x2; x++)
+#ifdef __SSE2__
+  if(count >= 8)
   {
-    *bufp = colorSDL;
-    bufp++;
+    while(size_t(pixels) & 15) {*pixels++ = color; count--;} //align to 16 bytes
+    __m128i c = _mm_set1_epi32(int(color));
+    for(; count >= 16; count -= 16, pixels += 16)
+    {
+      _mm_store_si128((__m128i*)(pixels + 0), c);
+      _mm_store_si128((__m128i*)(pixels + 4), c);
+      _mm_store_si128((__m128i*)(pixels + 8), c);
+      _mm_store_si128((__m128i*)(pixels + 12), c);
+    }
+    for(; count >= 4; count -= 4, pixels += 4) _mm_store_si128((__m128i*)pixels, c);
   }
-  return 1;
+#endif
+  while(count-- > 0) *pixels++ = color;
 }
 
+//Fast horizontal line from (x1,y) to (x2,y)
+bool horLine(const Canvas& canvas, int y, int x1, int x2, Uint32 color)
+{
+  if(x2 < x1) std::swap(x1, x2); //x1 must be the leftmost endpoint
+  if(x2 < 0 || x1 >= canvas.width || y < 0 || y >= canvas.height) return 0; //no single point of the line is on the canvas
+  if(x1 < 0) x1 = 0; //clip
+  if(x2 >= canvas.width) x2 = canvas.width - 1; //clip
+  fillSpan(canvas.pixels + y * canvas.pitch + x1, x2 - x1 + 1, color);
+  return 1;
+}
 
-//Fast vertical line from (x,y1) to (x,y2), with rgb color
-bool verLine(int x, int y1, int y2, const ColorRGB& color)
+//Fast vertical line from (x,y1) to (x,y2)
+bool verLine(const Canvas& canvas, int x, int y1, int y2, Uint32 color)
 {
-  if(y2 < y1) {y1 += y2; y2 = y1 - y2; y1 -= y2;} //swap y1 and y2
-  if(y2 < 0 || y1 >= h  || x < 0 || x >= w) return 0; //no single point of the line is on screen
+  if(y2 < y1) std::swap(y1, y2);
+  if(y2 < 0 || y1 >= canvas.height || x < 0 || x >= canvas.width) return 0; //no single point of the line is on the canvas
   if(y1 < 0) y1 = 0; //clip
-  if(y2 >= w) y2 = h - 1; //clip
-
-  Uint32 colorSDL = SDL_MapRGB(scr->format, color.r, color.g, color.b);
-  Uint32* bufp;
-
-  bufp = (Uint32*)scr->pixels + y1 * scr->pitch / 4 + x;
-  unsigned add = scr->pitch / 4;
-  for(int y = y1; y <= y2; y++)
-  {
-     *bufp = colorSDL;
-     bufp += add;
-  }
+  if(y2 >= canvas.height) y2 = canvas.height - 1; //clip
+  Uint32* bufp = canvas.pixels + y1 * canvas.pitch + x;
+  for(int y = y1; y <= y2; y++, bufp += canvas.pitch) *bufp = color;
   return 1;
 }
 
-
-//Bresenham line from (x1,y1) to (x2,y2) with rgb color
-bool drawLine(int x1, int y1, int x2, int y2, const ColorRGB& color)
+//Bresenham line from (x1,y1) to (x2,y2), clipped to the canvas first so the loop needs no checks
+bool drawLine(const Canvas& canvas, int x1, int y1, int x2, int y2, Uint32 color)
 {
-  if(x1 < 0 || x1 > w - 1 || x2 < 0 || x2 > w - 1 || y1 < 0 || y1 > h - 1 || y2 < 0 || y2 > h - 1) return 0;
+  if(!clipLine(canvas.width, canvas.height, x1, y1, x2, y2, x1, y1, x2, y2)) return 0;
 
-  int deltax = std::abs(x2 - x1); //The difference between the x's
-  int deltay = std::abs(y2 - y1); //The difference between the y's
-  int x = x1; //Start x off at the first pixel
-  int y = y1; //Start y off at the first pixel
-  int xinc1, xinc2, yinc1, yinc2, den, num, numadd, numpixels, curpixel;
+  int deltax = std::abs(x2 - x1);
+  int deltay = std::abs(y2 - y1);
+  int stepx = (x2 >= x1) ? 1 : -1;
+  int stepy = (y2 >= y1) ? canvas.pitch : -canvas.pitch;
+  Uint32* bufp = canvas.pixels + y1 * canvas.pitch + x1;
 
-  if(x2 >= x1) //The x-values are increasing
-  {
-    xinc1 = 1;
-    xinc2 = 1;
-  }
-  else //The x-values are decreasing
-  {
-    xinc1 = -1;
-    xinc2 = -1;
-  }
-  if(y2 >= y1) //The y-values are increasing
-  {
-    yinc1 = 1;
-    yinc2 = 1;
-  }
-  else //The y-values are decreasing
-  {
-    yinc1 = -1;
-    yinc2 = -1;
-  }
-  if (deltax >= deltay) //There is at least one x-value for every y-value
+  if(deltax >= deltay) //there is at least one x-value for every y-value
   {
-    xinc1 = 0; //Don't change the x when numerator >= denominator
-    yinc2 = 0; //Don't change the y for every iteration
-    den = deltax;
-    num = deltax / 2;
-    numadd = deltay;
-    numpixels = deltax; //There are more x-values than y-values
-  }
-  else //There is at least one y-value for every x-value
-  {
-    xinc2 = 0; //Don't change the x for every iteration
-    yinc1 = 0; //Don't change the y when numerator >= denominator
-    den = deltay;
-    num = deltay / 2;
-    numadd = deltax;
-    numpixels = deltay; //There are more y-values than x-values
+    int num = deltax / 2;
+    for(int i = 0; i <= deltax; i++)
+    {
+      *bufp = color;
+      num += deltay;
+      if(num >= deltax) {num -= deltax; bufp += stepy;}
+      bufp += stepx;
+    }
   }
-  for (curpixel = 0; curpixel <= numpixels; curpixel++)
+  else //there is at least one y-value for every x-value
   {
-    pset(x % w, y % h, color);  //Draw the current pixel
-    num += numadd;  //Increase the numerator by the top of the fraction
-    if (num >= den) //Check if numerator >= denominator
+    int num = deltay / 2;
+    for(int i = 0; i <= deltay; i++)
     {
-      num -= den; //Calculate the new numerator value
-      x += xinc1; //Change the x as appropriate
-      y += yinc1; //Change the y as appropriate
+      *bufp = color;
+      num += deltax;
+      if(num >= deltay) {num -= deltay; bufp += stepx;}
+      bufp += stepy;
     }
-    x += xinc2; //Change the x as appropriate
-    y += yinc2; //Change the y as appropriate
   }
-
   return 1;
 }
 
-
-//Bresenham circle with center at (xc,yc) with radius and red green blue color
-bool drawCircle(int xc, int yc, int radius, const ColorRGB& color)
+//Bresenham circle with center at (xc,yc). If the circle is entirely on the canvas, no pixel is checked.
+bool drawCircle(const Canvas& canvas, int xc, int yc, int radius, Uint32 color)
 {
-  if(xc - radius < 0 || xc + radius >= w || yc - radius < 0 || yc + radius >= h) return 0;
+  if(radius < 0 || xc + radius < 0 || xc - radius >= canvas.width || yc + radius < 0 || yc - radius >= canvas.height) return 0;
+  bool inside = xc - radius >= 0 && xc + radius < canvas.width && yc - radius >= 0 && yc + radius < canvas.height;
+  Uint32* center = canvas.pixels + yc * canvas.pitch + xc;
+  int pitch = canvas.pitch;
   int x = 0;
   int y = radius;
   int p = 3 - (radius << 1);
-  int a, b, c, d, e, f, g, h;
-  while (x <= y)
-  {
-     a = xc + x; //8 pixels can be calculated at once thanks to the symmetry
-     b = yc + y;
-     c = xc - x;
-     d = yc - y;
-     e = xc + y;
-     f = yc + x;
-     g = xc - y;
-     h = yc - x;
-     pset(a, b, color);
-     pset(c, d, color);
-     pset(e, f, color);
-     pset(g, f, color);
-     if(x > 0) //avoid drawing pixels at same position as the other ones
-     {
-       pset(a, d, color);
-       pset(c, b, color);
-       pset(e, h, color);
-       pset(g, h, color);
-     }
-     if(p < 0) p += (x++ << 2) + 6;
-     else p += ((x++ - y--) << 2) + 10;
+  while(x <= y)
+  {
+    //8 pixels at once thanks to the symmetry, the x > 0 ones avoid drawing the same pixel twice
+    const int dx[8] = {x, -x, y, -y, x, -x, y, -y};
+    const int dy[8] = {y, -y, x, x, -y, y, -x, -x};
+    int n = (x > 0) ? 8 : 4;
+    for(int i = 0; i < n; i++)
+    {
+      if(inside || (unsigned(xc + dx[i]) < unsigned(canvas.width) && unsigned(yc + dy[i]) < unsigned(canvas.height)))
+        center[dy[i] * pitch + dx[i]] = color;
+    }
+    if(p < 0) p += (x++ << 2) + 6;
+    else p += ((x++ - y--) << 2) + 10;
   }
-
   return 1;
 }
 
-
-//Filled bresenham circle with center at (xc,yc) with radius and red green blue color
-bool drawDisk(int xc, int yc, int radius, const ColorRGB& color)
+//Filled bresenham circle with center at (xc,yc), drawn as horizontal spans
+bool drawDisk(const Canvas& canvas, int xc, int yc, int radius, Uint32 color)
 {
-  if(xc + radius < 0 || xc - radius >= w || yc + radius < 0 || yc - radius >= h) return 0; //every single pixel outside screen, so don't waste time on it
+  if(radius < 0 || xc + radius < 0 || xc - radius >= canvas.width || yc + radius < 0 || yc - radius >= canvas.height) return 0; //every single pixel outside the canvas
   int x = 0;
   int y = radius;
   int p = 3 - (radius << 1);
-  int a, b, c, d, e, f, g, h;
-  int pb = yc + radius + 1, pd = yc + radius + 1; //previous values: to avoid drawing horizontal lines multiple times  (ensure initial value is outside the range)
-  while (x <= y)
-  {
-     // write data
-     a = xc + x;
-     b = yc + y;
-     c = xc - x;
-     d = yc - y;
-     e = xc + y;
-     f = yc + x;
-     g = xc - y;
-     h = yc - x;
-     if(b != pb) horLine(b, a, c, color);
-     if(d != pd) horLine(d, a, c, color);
-     if(f != b)  horLine(f, e, g, color);
-     if(h != d && h != f) horLine(h, e, g, color);
-     pb = b;
-     pd = d;
-     if(p < 0) p += (x++ << 2) + 6;
-     else p += ((x++ - y--) << 2) + 10;
+  int pb = yc + radius + 1, pd = yc + radius + 1; //previous values: to avoid drawing horizontal lines multiple times
+  while(x <= y)
+  {
+    int a = xc + x, b = yc + y, c = xc - x, d = yc - y;
+    int e = xc + y, f = yc + x, g = xc - y, k = yc - x;
+    if(b != pb) horLine(canvas, b, a, c, color);
+    if(d != pd) horLine(canvas, d, a, c, color);
+    if(f != b) horLine(canvas, f, e, g, color);
+    if(k != d && k != f) horLine(canvas, k, e, g, color);
+    pb = b;
+    pd = d;
+    if(p < 0) p += (x++ << 2) + 6;
+    else p += ((x++ - y--) << 2) + 10;
   }
+  return 1;
+}
 
+//Filled rectangle with corners (x1,y1) and (x2,y2)
+bool drawRect(const Canvas& canvas, int x1, int y1, int x2, int y2, Uint32 color)
+{
+  if(x2 < x1) std::swap(x1, x2);
+  if(y2 < y1) std::swap(y1, y2);
+  if(x2 < 0 || x1 >= canvas.width || y2 < 0 || y1 >= canvas.height) return 0;
+  x1 = std::max(x1, 0); x2 = std::min(x2, canvas.width - 1);
+  y1 = std::max(y1, 0); y2 = std::min(y2, canvas.height - 1);
+  Uint32* bufp = canvas.pixels + y1 * canvas.pitch + x1;
+  for(int y = y1; y <= y2; y++, bufp += canvas.pitch) fillSpan(bufp, x2 - x1 + 1, color);
   return 1;
 }
 
+//Rectangle mixed with what's already on the canvas, e.g. to darken the background of text
+bool blendRect(const Canvas& canvas, int x1, int y1, int x2, int y2, Uint32 color, int alpha)
+{
+  if(alpha >= 256) return drawRect(canvas, x1, y1, x2, y2, color);
+  if(x2 < x1) std::swap(x1, x2);
+  if(y2 < y1) std::swap(y1, y2);
+  if(alpha <= 0 || x2 < 0 || x1 >= canvas.width || y2 < 0 || y1 >= canvas.height) return 0;
+  x1 = std::max(x1, 0); x2 = std::min(x2, canvas.width - 1);
+  y1 = std::max(y1, 0); y2 = std::min(y2, canvas.height - 1);
+  //red and blue are blended together in one multiply, green and alpha in others
+  Uint32 rb = (color & 0xFF00FF) * alpha, g = (color & 0x00FF00) * alpha;
+  Uint32 inv = 256 - alpha;
+#ifdef __SSE2__
+  //4 pixels at a time, each channel widened to 16 bits
+  __m128i zero = _mm_setzero_si128();
+  __m128i invv = _mm_set1_epi16(short(inv));
+  __m128i add = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32(int(color)), zero), _mm_set1_epi16(short(alpha)));
+#endif
+  for(int y = y1; y <= y2; y++)
+  {
+    Uint32* bufp = canvas.pixels + y * canvas.pitch;
+    int x = x1;
+#ifdef __SSE2__
+    for(; x + 3 <= x2; x += 4)
+    {
+      __m128i c = _mm_loadu_si128((__m128i*)(bufp + x));
+      __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), invv), add), 8);
+      __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), invv), add), 8);
+      _mm_storeu_si128((__m128i*)(bufp + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for(; x <= x2; x++)
+    {
+      Uint32 c = bufp[x];
+      bufp[x] = ((((c & 0xFF00FF) * inv + rb) >> 8) & 0xFF00FF) | ((((c & 0x00FF00) * inv + g) >> 8) & 0x00FF00)
+              | ((((c >> 24) * inv + (color >> 24) * alpha) >> 8) << 24);
+    }
+  }
+  return 1;
+}
+
+//Fast horizontal line from (x1,y) to (x2,y), with rgb color
+bool horLine(int y, int x1, int x2, const ColorRGB& color)
+{
+  return horLine(screenCanvas(), y, x1, x2, SDL_MapRGB(scr->format, color.r, color.g, color.b));
+}
+
+//Fast vertical line from (x,y1) to (x,y2), with rgb color
+bool verLine(int x, int y1, int y2, const ColorRGB& color)
+{
+  return verLine(screenCanvas(), x, y1, y2, SDL_MapRGB(scr->format, color.r, color.g, color.b));
+}
+
+//Bresenham line from (x1,y1) to (x2,y2) with rgb color
+bool drawLine(int x1, int y1, int x2, int y2, const ColorRGB& color)
+{
+  return drawLine(screenCanvas(), x1, y1, x2, y2, SDL_MapRGB(scr->format, color.r, color.g, color.b));
+}
+
+//Bresenham circle with center at (xc,yc) with radius and red green blue color
+bool drawCircle(int xc, int yc, int radius, const ColorRGB& color)
+{
+  return drawCircle(screenCanvas(), xc, yc, radius, SDL_MapRGB(scr->format, color.r, color.g, color.b));
+}
+
+//Filled bresenham circle with center at (xc,yc) with radius and red green blue color
+bool drawDisk(int xc, int yc, int radius, const ColorRGB& color)
+{
+  return drawDisk(screenCanvas(), xc, yc, radius, SDL_MapRGB(scr->format, color.r, color.g, color.b));
+}
+
 //Rectangle with corners (x1,y1) and (x2,y2) and rgb color
 bool drawRect(int x1, int y1, int x2, int y2, const ColorRGB& color)
 {
-  if(x1 < 0 || x1 > w - 1 || x2 < 0 || x2 > w - 1 || y1 < 0 || y1 > h - 1 || y2 < 0 || y2 > h - 1) return 0;
-  SDL_Rect rec;
-  rec.x = x1;
-  rec.y = y1;
-  rec.w = x2 - x1 + 1;
-  rec.h = y2 - y1 + 1;
-  Uint32 colorSDL = SDL_MapRGB(scr->format, color.r, color.g, color.b);
-  SDL_FillRect(scr, &rec, colorSDL);  //SDL's ability to draw a hardware rectangle is used for now
-  return 1;
+  return drawRect(screenCanvas(), x1, y1, x2, y2, SDL_MapRGB(scr->format, color.r, color.g, color.b));
 }
 
 //Functions for clipping a 2D line to the screen, which is the rectangle (0,0)-(w,h)
@@ -523,25 +643,29 @@ bool drawRect(int x1, int y1, int x2, int y2, const ColorRGB& color)
 // 0001 0000 0010  1 0 2
 // 0101 0100 0110  5 4 6
 //int findregion returns which of the 9 regions a point is in, void clipline does the actual clipping
-int findRegion(int x, int y)
+int findRegion(int x, int y, int width, int height)
 {
   int code=0;
-  if(y >= h)
+  if(y >= height)
   code |= 1; //top
   else if( y < 0)
   code |= 2; //bottom
-  if(x >= w)
+  if(x >= width)
   code |= 4; //right
   else if ( x < 0)
   code |= 8; //left
   return(code);
 }
-bool clipLine(int x1, int y1, int x2, int y2, int & x3, int & y3, int & x4, int & y4)
+int findRegion(int x, int y)
+{
+  return findRegion(x, y, w, h);
+}
+bool clipLine(int width, int height, int x1, int y1, int x2, int y2, int & x3, int & y3, int & x4, int & y4)
 {
   int code1, code2, codeout;
   bool accept = 0, done=0;
-  code1 = findRegion(x1, y1); //the region outcodes for the endpoints
-  code2 = findRegion(x2, y2);
+  code1 = findRegion(x1, y1, width, height); //the region outcodes for the endpoints
+  code2 = findRegion(x2, y2, width, height);
   do  //In theory, this can never end up in an infinite loop, it'll always come in one of the trivial cases eventually
   {
     if(!(code1 | code2)) accept = done = 1;  //accept because both endpoints are in screen or on the border, trivial accept
@@ -552,33 +676,33 @@ bool clipLine(int x1, int y1, int x2, int y2, int & x3, int & y3, int & x4, int
       codeout = code1 ? code1 : code2;
       if(codeout & 1) //top
       {
-        x = x1 + (x2 - x1) * (h - y1) / (y2 - y1);
-        y = h - 1;
+        x = x1 + int((long long)(x2 - x1) * (height - 1 - y1) / (y2 - y1));
+        y = height - 1;
       }
       else if(codeout & 2) //bottom
       {
-        x = x1 + (x2 - x1) * -y1 / (y2 - y1);
+        x = x1 + int((long long)(x2 - x1) * -y1 / (y2 - y1));
         y = 0;
       }
       else if(codeout & 4) //right
       {
-        y = y1 + (y2 - y1) * (w - x1) / (x2 - x1);
-        x = w - 1;
+        y = y1 + int((long long)(y2 - y1) * (width - 1 - x1) / (x2 - x1));
+        x = width - 1;
       }
       else //left
       {
-        y = y1 + (y2 - y1) * -x1 / (x2 - x1);
+        y = y1 + int((long long)(y2 - y1) * -x1 / (x2 - x1));
         x = 0;
       }
       if(codeout == code1) //first endpoint was clipped
       {
         x1 = x; y1 = y;
-        code1 = findRegion(x1, y1);
+        code1 = findRegion(x1, y1, width, height);
       }
       else //second endpoint was clipped
       {
         x2 = x; y2 = y;
-        code2 = findRegion(x2, y2);
+        code2 = findRegion(x2, y2, width, height);
       }
     }
   }
@@ -598,7 +722,66 @@ bool clipLine(int x1, int y1, int x2, int y2, int & x3, int & y3, int & x4, int
     return 0;
   }
 }
+bool clipLine(int x1, int y1, int x2, int y2, int & x3, int & y3, int & x4, int & y4)
+{
+  return clipLine(w, h, x1, y1, x2, y2, x3, y3, x4, y4);
+}
 
+void DrawList::add(Type type, int a, int b, int c, int d, Uint32 color, int extra, Uint32 color2)
+{
+  Command command;
+  command.type = type;
+  command.a = a;
+  command.b = b;
+  command.c = c;
+  command.d = d;
+  command.extra = extra;
+  command.color = color;
+  command.color2 = color2;
+  commands.push_back(command);
+}
+
+void DrawList::horLine(int y, int x1, int x2, Uint32 color) { add(HOR_LINE, y, x1, x2, 0, color); }
+void DrawList::verLine(int x, int y1, int y2, Uint32 color) { add(VER_LINE, x, y1, y2, 0, color); }
+void DrawList::drawLine(int x1, int y1, int x2, int y2, Uint32 color) { add(LINE, x1, y1, x2, y2, color); }
+void DrawList::drawCircle(int xc, int yc, int radius, Uint32 color) { add(CIRCLE, xc, yc, radius, 0, color); }
+void DrawList::drawDisk(int xc, int yc, int radius, Uint32 color) { add(DISK, xc, yc, radius, 0, color); }
+void DrawList::drawRect(int x1, int y1, int x2, int y2, Uint32 color) { add(RECT, x1, y1, x2, y2, color); }
+void DrawList::blendRect(int x1, int y1, int x2, int y2, Uint32 color, int alpha) { add(BLEND_RECT, x1, y1, x2, y2, color, alpha); }
+
+void DrawList::printString(const std::string& text, int x, int y, Uint32 color, bool bg, Uint32 color2, int scale)
+{
+  int begin = int(chars.size());
+  chars += text;
+  add(TEXT, x, y, begin, int(chars.size()), color, scale | (bg ? 256 : 0), color2);
+}
+
+static int drawGlyphs(const Canvas& canvas, const char* text, size_t length, int x, int y, Uint32 color, bool bg, Uint32 color2, int scale);
+
+void DrawList::draw(const Canvas& canvas) const
+{
+  for(size_t i = 0; i < commands.size(); i++)
+  {
+    const Command& c = commands[i];
+    switch(c.type)
+    {
+      case HOR_LINE: QuickCG::horLine(canvas, c.a, c.b, c.c, c.color); break;
+      case VER_LINE: QuickCG::verLine(canvas, c.a, c.b, c.c, c.color); break;
+      case LINE: QuickCG::drawLine(canvas, c.a, c.b, c.c, c.d, c.color); break;
+      case CIRCLE: QuickCG::drawCircle(canvas, c.a, c.b, c.c, c.color); break;
+      case DISK: QuickCG::drawDisk(canvas, c.a, c.b, c.c, c.color); break;
+      case RECT: QuickCG::drawRect(canvas, c.a, c.b, c.c, c.d, c.color); break;
+      case BLEND_RECT: QuickCG::blendRect(canvas, c.a, c.b, c.c, c.d, c.color, c.extra); break;
+      case TEXT: drawGlyphs(canvas, chars.data() + c.c, c.d - c.c, c.a, c.b, c.color, (c.extra & 256) != 0, c.color2, c.extra & 255); break;
+    }
+  }
+}
+
+void DrawList::clear()
+{
+  commands.clear();
+  chars.clear();
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //COLOR STRUCTS/////////////////////////////////////////////////////////////////
@@ -948,15 +1131,69 @@ void saveFile(const std::vector<unsigned char>& buffer, const std::string& filen
   file.write(buffer.size() ? (char*)&buffer[0] : 0, std::streamsize(buffer.size()));
 }
 
+bool MappedFile::open(const std::string& filename, Access access, bool copyOnWrite)
+{
+  close();
+#ifndef _WIN32
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0) return false;
+  struct stat st;
+  if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) //some files report size 0 but do have contents, those are read below
+  {
+    void* map = mmap(0, size_t(st.st_size), copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map != MAP_FAILED)
+    {
+      ::close(fd); //the mapping keeps the file
+      static const int advice[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
+      madvise(map, size_t(st.st_size), advice[access]); //only a hint, failing is fine
+      data_ = (unsigned char*)map;
+      size_ = size_t(st.st_size);
+      mapped = true;
+      writable = copyOnWrite;
+      return true;
+    }
+  }
+  ::close(fd);
+#else
+  (void)access;
+#endif
+  //no mapping: read the file in chunks, this also works for pipes and such
+  FILE* file = fopen(filename.c_str(), "rb");
+  if(!file) return false;
+  unsigned char chunk[65536];
+  size_t n;
+  while((n = fread(chunk, 1, sizeof(chunk), file)) > 0) buffer.insert(buffer.end(), chunk, chunk + n);
+  bool ok = !ferror(file);
+  fclose(file);
+  if(!ok) { buffer.clear(); return false; }
+  data_ = buffer.empty() ? 0 : &buffer[0];
+  size_ = buffer.size();
+  writable = copyOnWrite; //the buffer is a private copy anyway
+  return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+  if(mapped) munmap((void*)data_, size_);
+#endif
+  std::vector<unsigned char>().swap(buffer);
+  data_ = 0;
+  size_ = 0;
+  mapped = false;
+  writable = false;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //IMAGE FUNCTIONS///////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
 int loadImage(std::vector<ColorRGB>& out, unsigned long& w, unsigned long& h, const std::string& filename)
 {
-  std::vector<unsigned char> file, image;
-  loadFile(file, filename);
-  if(decodePNG(image, w, h, file)) return 1;
+  std::vector<unsigned char> image;
+  MappedFile file(filename);
+  if(decodePNG(image, w, h, file.data(), file.size())) return 1;
+  file.close(); //the compressed data isn't needed anymore
 
   out.resize(image.size() / 4);
 
@@ -971,49 +1208,218 @@ int loadImage(std::vector<ColorRGB>& out, unsigned long& w, unsigned long& h, co
   return 0;
 }
 
+//like loadImage but returns the decodePNG error code
+static int loadImageARGB(std::vector<Uint32>& out, unsigned long& w, unsigned long& h, const std::string& filename)
+{
+  MappedFile file(filename);
+  return decodePNG(out, w, h, file.data(), file.size());
+}
+
 int loadImage(std::vector<Uint32>& out, unsigned long& w, unsigned long& h, const std::string& filename)
 {
-  std::vector<unsigned char> file, image;
-  loadFile(file, filename);
-  if(decodePNG(image, w, h, file)) return 1;
+  return loadImageARGB(out, w, h, filename) ? 1 : 0;
+}
 
-  out.resize(image.size() / 4);
+//work shared by the threads of loadImages
+struct ImageBatch
+{
+  std::vector<Uint32>* out;
+  std::vector<ImageRequest>* requests;
+  std::vector<size_t> first; //for every distinct file, the first request that asks for it
+  size_t next; //next entry of first that nobody took yet
+  SDL_mutex* mutex;
+};
 
-  for(size_t i = 0; i < out.size(); i++)
+static int loadImageWorker(void* data)
+{
+  ImageBatch& batch = *(ImageBatch*)data;
+  for(;;)
   {
-    out[i] = 0x1000000 * image[i * 4 + 3] + 0x10000 * image[i * 4 + 0] + 0x100 * image[i * 4 + 1] + image[i * 4 + 2];
+    SDL_mutexP(batch.mutex);
+    bool done = batch.next >= batch.first.size();
+    size_t job = done ? 0 : batch.first[batch.next++];
+    SDL_mutexV(batch.mutex);
+    if(done) return 0;
+
+    //every job writes only its own slot and request, so the decoding itself needs no lock
+    ImageRequest& r = (*batch.requests)[job];
+    r.error = loadImageARGB(batch.out[r.slot], r.w, r.h, r.filename);
   }
+}
 
-  return 0;
+int loadImages(std::vector<Uint32>* out, std::vector<ImageRequest>& requests, int threads)
+{
+  ImageBatch batch;
+  batch.out = out;
+  batch.requests = &requests;
+  batch.next = 0;
+
+  std::map<std::string, size_t> seen; //decode each file once
+  std::vector<size_t> source(requests.size());
+  for(size_t i = 0; i < requests.size(); i++)
+  {
+    std::map<std::string, size_t>::iterator it = seen.find(requests[i].filename);
+    if(it == seen.end()) { seen[requests[i].filename] = i; batch.first.push_back(i); source[i] = i; }
+    else source[i] = it->second;
+  }
+
+  if(threads <= 0) threads = int(std::thread::hardware_concurrency());
+  if(threads > int(batch.first.size())) threads = int(batch.first.size());
+  if(threads < 1) threads = 1;
+
+  batch.mutex = SDL_CreateMutex();
+  std::vector<SDL_Thread*> workers;
+  for(int i = 1; i < threads; i++) //the calling thread is the last worker
+  {
+    SDL_Thread* thread = SDL_CreateThread(loadImageWorker, &batch);
+    if(thread) workers.push_back(thread);
+  }
+  loadImageWorker(&batch);
+  for(size_t i = 0; i < workers.size(); i++) SDL_WaitThread(workers[i], 0);
+  SDL_DestroyMutex(batch.mutex);
+
+  int failed = 0;
+  for(size_t i = 0; i < requests.size(); i++)
+  {
+    const ImageRequest& s = requests[source[i]];
+    if(source[i] != i)
+    {
+      requests[i].w = s.w;
+      requests[i].h = s.h;
+      requests[i].error = s.error;
+      if(!s.error) out[requests[i].slot] = out[s.slot];
+    }
+    if(requests[i].error) failed++;
+  }
+  return failed;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //TEXT FUNCTIONS////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
-//Draws character n at position x,y with color RGB and, if enabled, background color
-//This function is used by the text printing functions below, and uses the font data
-//defined below to draw the letter pixel by pixel
-void drawLetter(unsigned char n, int x, int y, const ColorRGB& color, bool bg, const ColorRGB& color2)
+//Glyph rows of the font scaled up by the given factor, one Uint64 per row with bit x for column x.
+//Each size is expanded the first time it's used and kept, scale 1 uses the font itself.
+static const Uint64* scaledGlyphs(int scale)
 {
-  int u,v;
+  static std::vector<Uint64> cache[9];
+  std::vector<Uint64>& rows = cache[scale];
+  if(rows.empty())
+  {
+    int size = 8 * scale;
+    rows.resize(256 * size);
+    for(int c = 0; c < 256; c++)
+    for(int y = 0; y < size; y++)
+    {
+      Uint64 row = 0;
+      for(int x = 0; x < size; x++) if((font[c][y / scale] >> (x / scale)) & 1) row |= Uint64(1) << x;
+      rows[c * size + y] = row;
+    }
+  }
+  return &rows[0];
+}
+
+//Draws a run of glyphs into the canvas. Clipping is worked out once for the whole run, then it's
+//drawn row by row over all glyphs, so the writes walk along the canvas instead of jumping between rows.
+static int drawGlyphs(const Canvas& canvas, const char* text, size_t length, int x, int y, Uint32 color, bool bg, Uint32 color2, int scale)
+{
+  if(scale < 1) scale = 1;
+  if(scale > 8) scale = 8;
+  int size = 8 * scale;
+  int endx = x + int(length) * size;
+
+  int r0 = std::max(0, -y), r1 = std::min(size, canvas.height - y); //visible glyph rows
+  if(r0 >= r1 || endx <= 0 || x >= canvas.width) return endx;
+  size_t first = x < 0 ? size_t(-x / size) : 0; //visible characters
+  size_t last = std::min(length, size_t((canvas.width - x + size - 1) / size));
 
-  for (v = 0; v < 8; v++)
-  for (u = 0; u < 8; u++)
+  const Uint64* scaled = scale > 1 ? scaledGlyphs(scale) : 0;
+  for(int r = r0; r < r1; r++)
   {
-    if(font[n][u][v]) pset(x + u, y + v, color);
-    else if(bg) pset(x + u, y + v, color2);
+    Uint32* row = canvas.pixels + (y + r) * canvas.pitch;
+    for(size_t i = first; i < last; i++)
+    {
+      int gx = x + int(i) * size;
+      unsigned char n = text[i];
+      Uint64 bits = scaled ? scaled[n * size + r] : font[n][r];
+      int c0 = gx < 0 ? -gx : 0, c1 = std::min(size, canvas.width - gx); //visible columns of this glyph
+      Uint32* bufp = row + gx;
+      if(bg)
+      {
+        for(int c = c0; c < c1; c++) bufp[c] = ((bits >> c) & 1) ? color : color2;
+      }
+      else
+      {
+        bits &= (c1 >= 64 ? ~Uint64(0) : ((Uint64(1) << c1) - 1)) & ~((Uint64(1) << c0) - 1);
+        while(bits)
+        {
+          bufp[__builtin_ctzll(bits)] = color;
+          bits &= bits - 1;
+        }
+      }
+    }
   }
+  return endx;
+}
+
+int drawLetter(const Canvas& canvas, unsigned char n, int x, int y, Uint32 color, bool bg, Uint32 color2, int scale)
+{
+  char c = n;
+  return drawGlyphs(canvas, &c, 1, x, y, color, bg, color2, scale);
+}
+
+int printString(const Canvas& canvas, const std::string& text, int x, int y, Uint32 color, bool bg, Uint32 color2, int scale)
+{
+  return drawGlyphs(canvas, text.data(), text.size(), x, y, color, bg, color2, scale);
+}
+
+void TextBatch::add(const std::string& text, int x, int y, Uint32 color, bool bg, Uint32 color2, int scale)
+{
+  Item item;
+  item.begin = chars.size();
+  chars += text;
+  item.end = chars.size();
+  item.x = x;
+  item.y = y;
+  item.scale = scale;
+  item.color = color;
+  item.color2 = color2;
+  item.bg = bg;
+  items.push_back(item);
 }
 
-//Draws a string of text
+void TextBatch::draw(const Canvas& canvas) const
+{
+  for(size_t i = 0; i < items.size(); i++)
+  {
+    const Item& item = items[i];
+    drawGlyphs(canvas, chars.data() + item.begin, item.end - item.begin, item.x, item.y, item.color, item.bg, item.color2, item.scale);
+  }
+}
+
+void TextBatch::clear()
+{
+  items.clear();
+  chars.clear();
+}
+
+//Draws character n at position x,y on the screen with color RGB and, if enabled, background color
+void drawLetter(unsigned char n, int x, int y, const ColorRGB& color, bool bg, const ColorRGB& color2)
+{
+  drawLetter(screenCanvas(), n, x, y, SDL_MapRGB(scr->format, color.r, color.g, color.b), bg, SDL_MapRGB(scr->format, color2.r, color2.g, color2.b));
+}
+
+//Draws a string of text on the screen
 int printString(const std::string& text, int x, int y, const ColorRGB& color, bool bg, const ColorRGB& color2, int forceLength)
 {
+  Canvas canvas = screenCanvas();
+  Uint32 colorSDL = SDL_MapRGB(scr->format, color.r, color.g, color.b);
+  Uint32 color2SDL = SDL_MapRGB(scr->format, color2.r, color2.g, color2.b);
   int amount = 0;
   for(size_t i = 0; i < text.size(); i++)
   {
     amount++;
-    drawLetter(text[i], x, y, color, bg, color2);
+    drawLetter(canvas, text[i], x, y, colorSDL, bg, color2SDL);
     x += 8;
     if(x > w - 8) {x %= 8; y += 8;}
     if(y > h - 8) {y %= 8;}
@@ -1021,7 +1427,7 @@ int printString(const std::string& text, int x, int y, const ColorRGB& color, bo
   while(amount < forceLength)
   {
     amount++;
-    drawLetter(' ', x, y, color, bg, color2);
+    drawLetter(canvas, ' ', x, y, colorSDL, bg, color2SDL);
     x += 8;
     if(x > w - 8) {x %= 8; y += 8;}
     if(y > h - 8) {y %= 8;}
@@ -1180,7 +1586,275 @@ void decodeBase64(std::vector<unsigned char>& out, const std::string& in)
 // PNG                                                                        //
 ////////////////////////////////////////////////////////////////////////////////
 
-int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32)
+//SIMD versions of the PNG unfilter loops, picked at runtime by what the CPU supports. Sub, Average and Paeth depend on the
+//pixel to the left, so for 3 and 4 bytes per pixel they go one whole pixel per step in the low lanes of a register; Up has
+//no such dependency and goes 16 or 32 bytes per step for any pixel size. All of them give the same bytes as the scalar code.
+#ifdef QUICKCG_SIMD_PNG
+
+struct SimdCPU //what the running CPU supports beyond SSE2, which every x86-64 CPU has
+{
+  bool ssse3, avx2;
+  SimdCPU() { __builtin_cpu_init(); ssse3 = __builtin_cpu_supports("ssse3"); avx2 = __builtin_cpu_supports("avx2"); }
+};
+
+static const SimdCPU& simdCPU()
+{
+  static const SimdCPU cpu;
+  return cpu;
+}
+
+template<size_t BPP> static inline __m128i loadPixel(const unsigned char* p)
+{
+  Uint32 v = 0;
+  memcpy(&v, p, BPP); //BPP is 3 or 4, a 3 byte pixel mustn't read past the end of the line
+  return _mm_cvtsi32_si128(int(v));
+}
+
+template<size_t BPP> static inline void storePixel(unsigned char* p, __m128i v)
+{
+  Uint32 x = Uint32(_mm_cvtsi128_si32(v));
+  memcpy(p, &x, BPP);
+}
+
+static void unfilterUpSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t length)
+{
+  size_t i = 0;
+  for(; i + 16 <= length; i += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i)), b = _mm_loadu_si128((const __m128i*)(precon + i));
+    _mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(x, b));
+  }
+  for(; i < length; i++) recon[i] = scanline[i] + precon[i];
+}
+
+__attribute__((target("avx2"))) static void unfilterUpAVX2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t length)
+{
+  size_t i = 0;
+  for(; i + 32 <= length; i += 32)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(scanline + i)), b = _mm256_loadu_si256((const __m256i*)(precon + i));
+    _mm256_storeu_si256((__m256i*)(recon + i), _mm256_add_epi8(x, b));
+  }
+  for(; i < length; i++) recon[i] = scanline[i] + precon[i];
+}
+
+template<size_t BPP> static void unfilterSubSSE2(unsigned char* recon, const unsigned char* scanline, size_t length)
+{
+  __m128i a = _mm_setzero_si128();
+  for(size_t i = 0; i < length; i += BPP)
+  {
+    a = _mm_add_epi8(a, loadPixel<BPP>(scanline + i));
+    storePixel<BPP>(recon + i, a);
+  }
+}
+
+template<size_t BPP> static void unfilterAverageSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t length)
+{
+  __m128i a = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+  for(size_t i = 0; i < length; i += BPP)
+  {
+    __m128i b = loadPixel<BPP>(precon + i);
+    //_mm_avg_epu8 rounds up, the filter rounds down: subtract the carried low bit
+    __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+    a = _mm_add_epi8(loadPixel<BPP>(scanline + i), avg);
+    storePixel<BPP>(recon + i, a);
+  }
+}
+
+//Paeth in 16-bit lanes: with pa, pb and pc as in paethPredictor, the predictor is the first of a, b, c whose distance is the smallest
+template<size_t BPP> static void unfilterPaethSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t length)
+{
+  __m128i zero = _mm_setzero_si128(), a = zero, c = zero;
+  for(size_t i = 0; i < length; i += BPP)
+  {
+    __m128i b = _mm_unpacklo_epi8(loadPixel<BPP>(precon + i), zero);
+    __m128i pa = _mm_sub_epi16(b, c), pb = _mm_sub_epi16(a, c), pc = _mm_add_epi16(pa, pb);
+    pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+    pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+    pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+    __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    __m128i useB = _mm_cmpeq_epi16(pb, smallest), useA = _mm_cmpeq_epi16(pa, smallest);
+    __m128i nearest = _mm_or_si128(_mm_and_si128(useB, b), _mm_andnot_si128(useB, c));
+    nearest = _mm_or_si128(_mm_and_si128(useA, a), _mm_andnot_si128(useA, nearest));
+    a = _mm_and_si128(_mm_add_epi16(_mm_unpacklo_epi8(loadPixel<BPP>(scanline + i), zero), nearest), _mm_set1_epi16(255));
+    storePixel<BPP>(recon + i, _mm_packus_epi16(a, a));
+    c = b;
+  }
+}
+
+//the same with SSSE3's absolute value
+template<size_t BPP> __attribute__((target("ssse3"))) static void unfilterPaethSSSE3(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t length)
+{
+  __m128i zero = _mm_setzero_si128(), a = zero, c = zero;
+  for(size_t i = 0; i < length; i += BPP)
+  {
+    __m128i b = _mm_unpacklo_epi8(loadPixel<BPP>(precon + i), zero);
+    __m128i pa = _mm_sub_epi16(b, c), pb = _mm_sub_epi16(a, c), pc = _mm_add_epi16(pa, pb);
+    pa = _mm_abs_epi16(pa);
+    pb = _mm_abs_epi16(pb);
+    pc = _mm_abs_epi16(pc);
+    __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    __m128i useB = _mm_cmpeq_epi16(pb, smallest), useA = _mm_cmpeq_epi16(pa, smallest);
+    __m128i nearest = _mm_or_si128(_mm_and_si128(useB, b), _mm_andnot_si128(useB, c));
+    nearest = _mm_or_si128(_mm_and_si128(useA, a), _mm_andnot_si128(useA, nearest));
+    a = _mm_and_si128(_mm_add_epi16(_mm_unpacklo_epi8(loadPixel<BPP>(scanline + i), zero), nearest), _mm_set1_epi16(255));
+    storePixel<BPP>(recon + i, _mm_packus_epi16(a, a));
+    c = b;
+  }
+}
+
+template<size_t BPP> static bool unfilterPixels(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, unsigned long filterType, size_t length)
+{
+  switch(filterType)
+  {
+    case 1: unfilterSubSSE2<BPP>(recon, scanline, length); return true;
+    case 3: if(!precon) return false; unfilterAverageSSE2<BPP>(recon, scanline, precon, length); return true;
+    case 4:
+      if(!precon) return false;
+      if(simdCPU().ssse3) unfilterPaethSSSE3<BPP>(recon, scanline, precon, length);
+      else unfilterPaethSSE2<BPP>(recon, scanline, precon, length);
+      return true;
+    default: return false;
+  }
+}
+
+//unfilters a scanline like PNG::unFilterScanline if there's a SIMD version for it, returns false if not
+static bool unFilterScanlineSIMD(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t bytewidth, unsigned long filterType, size_t length)
+{
+  if(filterType == 2 && precon)
+  {
+    if(simdCPU().avx2) unfilterUpAVX2(recon, scanline, precon, length);
+    else unfilterUpSSE2(recon, scanline, precon, length);
+    return true;
+  }
+  if(length % bytewidth != 0) return false;
+  if(bytewidth == 4) return unfilterPixels<4>(recon, scanline, precon, filterType, length);
+  if(bytewidth == 3) return unfilterPixels<3>(recon, scanline, precon, filterType, length);
+  return false;
+}
+
+#else
+
+static bool unFilterScanlineSIMD(unsigned char*, const unsigned char*, const unsigned char*, size_t, unsigned long, size_t) { return false; }
+
+#endif
+
+//Conversions of decoded PNG pixels to the 0xAARRGGBB pixels loadImage gives, written straight into the destination texture.
+//In memory an ARGB pixel is the bytes B, G, R, A (x86 is little endian), so RGBA only needs R and B swapped.
+#ifdef QUICKCG_SIMD_PNG
+
+static void convertRGBAtoARGB_SSE2(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  size_t i = 0;
+  __m128i ag = _mm_set1_epi32(int(0xFF00FF00)), rb = _mm_set1_epi32(0x000000FF);
+  for(; i + 4 <= numpixels; i += 4)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i*)(in + 4 * i));
+    __m128i r = _mm_and_si128(x, rb), b = _mm_and_si128(_mm_srli_epi32(x, 16), rb);
+    _mm_storeu_si128((__m128i*)(out + i), _mm_or_si128(_mm_and_si128(x, ag), _mm_or_si128(_mm_slli_epi32(r, 16), b)));
+  }
+  for(; i < numpixels; i++) out[i] = 0x1000000U * in[i * 4 + 3] + 0x10000 * in[i * 4 + 0] + 0x100 * in[i * 4 + 1] + in[i * 4 + 2];
+}
+
+__attribute__((target("ssse3"))) static void convertRGBAtoARGB_SSSE3(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  size_t i = 0;
+  __m128i swap = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  for(; i + 4 <= numpixels; i += 4)
+    _mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 4 * i)), swap));
+  for(; i < numpixels; i++) out[i] = 0x1000000U * in[i * 4 + 3] + 0x10000 * in[i * 4 + 0] + 0x100 * in[i * 4 + 1] + in[i * 4 + 2];
+}
+
+__attribute__((target("avx2"))) static void convertRGBAtoARGB_AVX2(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  size_t i = 0;
+  __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  for(; i + 8 <= numpixels; i += 8)
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 4 * i)), swap));
+  for(; i < numpixels; i++) out[i] = 0x1000000U * in[i * 4 + 3] + 0x10000 * in[i * 4 + 0] + 0x100 * in[i * 4 + 1] + in[i * 4 + 2];
+}
+
+static void convertRGBAtoARGB(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  if(simdCPU().avx2) convertRGBAtoARGB_AVX2(out, in, numpixels);
+  else if(simdCPU().ssse3) convertRGBAtoARGB_SSSE3(out, in, numpixels);
+  else convertRGBAtoARGB_SSE2(out, in, numpixels);
+}
+
+//4 pixels per step from 12 bytes, the 16 byte loads stay inside the input by stopping 2 pixels early
+__attribute__((target("ssse3"))) static void convertRGBtoARGB_SSSE3(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  size_t i = 0;
+  __m128i spread = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1), alpha = _mm_set1_epi32(int(0xFF000000));
+  for(; i + 6 <= numpixels; i += 4)
+    _mm_storeu_si128((__m128i*)(out + i), _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 3 * i)), spread), alpha));
+  for(; i < numpixels; i++) out[i] = 0xFF000000 + 0x10000 * in[i * 3 + 0] + 0x100 * in[i * 3 + 1] + in[i * 3 + 2];
+}
+
+static void convertRGBtoARGB(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  if(simdCPU().ssse3) { convertRGBtoARGB_SSSE3(out, in, numpixels); return; }
+  for(size_t i = 0; i < numpixels; i++) out[i] = 0xFF000000 + 0x10000 * in[i * 3 + 0] + 0x100 * in[i * 3 + 1] + in[i * 3 + 2];
+}
+
+static void convertGreyToARGB(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  size_t i = 0;
+  __m128i ff = _mm_set1_epi8(-1);
+  for(; i + 16 <= numpixels; i += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+    __m128i gg = _mm_unpacklo_epi8(x, x), ga = _mm_unpacklo_epi8(x, ff); //pixels 0-7 as g,g and g,255
+    _mm_storeu_si128((__m128i*)(out + i + 0), _mm_unpacklo_epi16(gg, ga));
+    _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(gg, ga));
+    gg = _mm_unpackhi_epi8(x, x); ga = _mm_unpackhi_epi8(x, ff); //pixels 8-15
+    _mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpacklo_epi16(gg, ga));
+    _mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(gg, ga));
+  }
+  for(; i < numpixels; i++) out[i] = 0xFF000000 + 0x10101 * in[i];
+}
+
+static void convertGreyAlphaToARGB(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  size_t i = 0;
+  __m128i low = _mm_set1_epi16(0x00FF);
+  for(; i + 8 <= numpixels; i += 8)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i*)(in + 2 * i)); //g,a pairs
+    __m128i g = _mm_and_si128(x, low);
+    __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+    _mm_storeu_si128((__m128i*)(out + i + 0), _mm_unpacklo_epi16(gg, x));
+    _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(gg, x));
+  }
+  for(; i < numpixels; i++) out[i] = 0x1000000U * in[2 * i + 1] + 0x10101 * in[2 * i];
+}
+
+#else
+
+static void convertRGBAtoARGB(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  for(size_t i = 0; i < numpixels; i++) out[i] = 0x1000000U * in[i * 4 + 3] + 0x10000 * in[i * 4 + 0] + 0x100 * in[i * 4 + 1] + in[i * 4 + 2];
+}
+
+static void convertRGBtoARGB(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  for(size_t i = 0; i < numpixels; i++) out[i] = 0xFF000000 + 0x10000 * in[i * 3 + 0] + 0x100 * in[i * 3 + 1] + in[i * 3 + 2];
+}
+
+static void convertGreyToARGB(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  for(size_t i = 0; i < numpixels; i++) out[i] = 0xFF000000 + 0x10101 * in[i];
+}
+
+static void convertGreyAlphaToARGB(Uint32* out, const unsigned char* in, size_t numpixels)
+{
+  for(size_t i = 0; i < numpixels; i++) out[i] = 0x1000000U * in[2 * i + 1] + 0x10101 * in[2 * i];
+}
+
+#endif
+
+//decodes into out_image, or when out_argb is given, streams the image straight into that instead
+static int decodePNG(std::vector<unsigned char>& out_image, std::vector<Uint32>* out_argb, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32)
 {
   // picoPNG version 20101224
   // Copyright (c) 2005-2010 Lode Vandevenne
@@ -1208,105 +1882,180 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
   static const unsigned long CLCL[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15}; //code length code lengths
   struct Zlib //nested functions for zlib decompression
   {
-    static unsigned long readBitFromStream(size_t& bitp, const unsigned char* bits) { unsigned long result = (bits[bitp >> 3] >> (bitp & 0x7)) & 1; bitp++; return result;}
-    static unsigned long readBitsFromStream(size_t& bitp, const unsigned char* bits, size_t nbits)
+    struct Segment { const unsigned char* data; size_t size; }; //a piece of the compressed stream, PNG splits it over IDAT chunks
+    struct BitReader //the deflate bit stream, read through a 64-bit buffer that is refilled a word at a time
     {
-      unsigned long result = 0;
-      for(size_t i = 0; i < nbits; i++) result += (readBitFromStream(bitp, bits)) << i;
-      return result;
-    }
+      const unsigned char* in;
+      size_t size, pos; //of the current segment, pos is the next byte to load into buf. Bytes past the last segment load as zeros
+      const Segment* segments;
+      size_t numSegments, segment;
+      size_t base, total; //bytes in the segments before the current one, bytes in all segments
+      Uint64 buf;
+      unsigned count; //number of valid bits in buf
+      void init(const Segment* segs, size_t n)
+      {
+        segments = segs; numSegments = n; segment = 0; base = 0; total = 0;
+        for(size_t i = 0; i < n; i++) total += segs[i].size;
+        in = n ? segs[0].data : 0; size = n ? segs[0].size : 0; pos = 0; buf = 0; count = 0;
+      }
+      bool nextSegment()
+      {
+        if(segment + 1 >= numSegments) return false;
+        base += size; segment++;
+        in = segments[segment].data; size = segments[segment].size; pos = 0;
+        return true;
+      }
+      void refill() //after this there are at least 56 bits in buf
+      {
+        if(pos + 8 <= size)
+        {
+          Uint64 word = 0;
+          for(int i = 0; i < 8; i++) word |= Uint64(in[pos + i]) << (8 * i); //compiles to a single load on little endian machines
+          buf |= word << count;
+          pos += (63 - count) >> 3;
+          count |= 56;
+        }
+        else for(; count <= 56; count += 8, pos++)
+        {
+          while(pos >= size && nextSegment()) {}
+          buf |= Uint64(pos < size ? in[pos] : 0) << count;
+        }
+      }
+      unsigned long peek(unsigned n) const { return (unsigned long)(buf & ((Uint64(1) << n) - 1)); }
+      void consume(unsigned n) { buf >>= n; count -= n; }
+      unsigned long bits(unsigned n) { if(count < n) refill(); unsigned long result = peek(n); consume(n); return result; }
+      bool pastEnd() const { return (base + pos) * 8 - count > total * 8; } //true if bits beyond the input were used
+      void alignToByte() { consume(count & 7); }
+      bool readBytes(unsigned char* dst, size_t n) //the next n bytes, at a byte boundary. Returns false if the stream ends first
+      {
+        for(; n > 0 && count >= 8; n--) { *dst++ = (unsigned char)(buf & 255); consume(8); }
+        if(n > 0) buf = 0; //drained, refill may have left bits of the bytes about to be copied above count
+        while(n > 0)
+        {
+          while(pos >= size) if(!nextSegment()) return false;
+          size_t k = (n < size - pos) ? n : size - pos;
+          memcpy(dst, in + pos, k);
+          dst += k; pos += k; n -= k;
+        }
+        return !pastEnd();
+      }
+    };
+    struct Sink //receives the inflated bytes when streaming, returns an error value
+    {
+      virtual int write(const unsigned char* data, size_t size) = 0;
+    };
     struct HuffmanTree
     {
-      int makeFromLengths(const std::vector<unsigned long>& bitlen, unsigned long maxbitlen)
-      { //make tree given the lengths
-        unsigned long numcodes = (unsigned long)(bitlen.size()), treepos = 0, nodefilled = 0;
-        std::vector<unsigned long> tree1d(numcodes), blcount(maxbitlen + 1, 0), nextcode(maxbitlen + 1, 0);
-        for(unsigned long bits = 0; bits < numcodes; bits++) blcount[bitlen[bits]]++; //count number of instances of each code length
-        for(unsigned long bits = 1; bits <= maxbitlen; bits++) nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
-        for(unsigned long n = 0; n < numcodes; n++) if(bitlen[n] != 0) tree1d[n] = nextcode[bitlen[n]]++; //generate all the codes
-        tree2d.clear(); tree2d.resize(numcodes * 2, 32767); //32767 here means the tree2d isn't filled there yet
-        for(unsigned long n = 0; n < numcodes; n++) //the codes
-        for(unsigned long i = 0; i < bitlen[n]; i++) //the bits for this code
+      enum { FASTBITS = 10 }; //codes up to this length are decoded with one table lookup
+      Uint16 fast[1 << FASTBITS]; //indexed by the next FASTBITS bits of the stream: symbol << 4 | code length, 0 for longer codes
+      Uint16 count[16]; //number of codes of each length
+      Uint16 symbol[288]; //symbols ordered by code, for the codes longer than FASTBITS
+      int makeFromLengths(const unsigned long* bitlen, size_t numcodes)
+      { //make the tables given the lengths, returns 55 if the lengths are over-subscribed
+        for(int len = 0; len < 16; len++) count[len] = 0;
+        for(size_t n = 0; n < numcodes; n++) count[bitlen[n]]++;
+        count[0] = 0;
+        int left = 1;
+        for(int len = 1; len < 16; len++) { left <<= 1; left -= count[len]; if(left < 0) return 55; }
+        Uint16 offs[16]; offs[1] = 0;
+        for(int len = 1; len < 15; len++) offs[len + 1] = offs[len] + count[len];
+        for(size_t n = 0; n < numcodes; n++) if(bitlen[n] != 0) symbol[offs[bitlen[n]]++] = Uint16(n);
+        for(int i = 0; i < (1 << FASTBITS); i++) fast[i] = 0;
+        unsigned long code = 0;
+        for(int len = 1, index = 0; len <= FASTBITS; len++, code <<= 1) //walk the canonical codes, shortest first
+        for(int i = 0; i < count[len]; i++, code++, index++)
         {
-          unsigned long bit = (tree1d[n] >> (bitlen[n] - i - 1)) & 1;
-          if(treepos > numcodes - 2) return 55;
-          if(tree2d[2 * treepos + bit] == 32767) //not yet filled in
-          {
-            if(i + 1 == bitlen[n]) { tree2d[2 * treepos + bit] = n; treepos = 0; } //last bit
-            else { tree2d[2 * treepos + bit] = ++nodefilled + numcodes; treepos = nodefilled; } //addresses are encoded as values > numcodes
-          }
-          else treepos = tree2d[2 * treepos + bit] - numcodes; //subtract numcodes from address to get address value
+          unsigned long reversed = 0; //codes are stored most significant bit first
+          for(int b = 0; b < len; b++) reversed |= ((code >> b) & 1) << (len - 1 - b);
+          for(unsigned long j = reversed; j < (1u << FASTBITS); j += 1u << len) fast[j] = Uint16(symbol[index] << 4 | len);
         }
         return 0;
       }
-      int decode(bool& decoded, unsigned long& result, size_t& treepos, unsigned long bit) const
-      { //Decodes a symbol from the tree
-        unsigned long numcodes = (unsigned long)tree2d.size() / 2;
-        if(treepos >= numcodes) return 11; //error: you appeared outside the codetree
-        result = tree2d[2 * treepos + bit];
-        decoded = (result < numcodes);
-        treepos = decoded ? 0 : result - numcodes;
-        return 0;
+      int decode(BitReader& reader, unsigned long& result) const
+      { //decodes one symbol, there must be at least 15 bits in the reader. Returns 11 for a code that isn't in the tree
+        unsigned entry = fast[reader.peek(FASTBITS)];
+        if(entry) { reader.consume(entry & 15); result = entry >> 4; return 0; }
+        int code = 0, first = 0, index = 0;
+        for(unsigned len = 1; len < 16; len++) //canonical decoding, one bit at a time
+        {
+          code |= int((reader.buf >> (len - 1)) & 1);
+          int n = count[len];
+          if(code - n < first) { reader.consume(len); result = symbol[index + (code - first)]; return 0; }
+          index += n; first += n; first <<= 1; code <<= 1;
+        }
+        return 11;
       }
-      std::vector<unsigned long> tree2d; //2D representation of a huffman tree: The one dimension is "0" or "1", the other contains all nodes and leaves of the tree.
     };
     struct Inflator
     {
+      //when streaming, out is a window: the last WINDOW bytes for back references, then room for FLUSH new bytes and a match
+      enum { WINDOW = 32768, FLUSH = 65536 };
       int error;
-      void inflate(std::vector<unsigned char>& out, const std::vector<unsigned char>& in, size_t inpos = 0)
+      BitReader reader; //set up by decompress
+      Sink* sink; //0 to inflate everything into out
+      size_t flushed; //when streaming, the bytes of out before this were written to the sink already
+      HuffmanTree codetree, codetreeD, codelengthcodetree; //the code tree for Huffman codes, dist codes, and code length codes
+      void inflate(std::vector<unsigned char>& out, Sink* outSink)
       {
-        size_t bp = 0, pos = 0; //bit pointer and byte pointer
+        size_t pos = 0; //byte position in the out buffer
         error = 0;
+        sink = outSink;
+        flushed = 0;
+        if(sink) out.resize(WINDOW + FLUSH + 258 + 8);
         unsigned long BFINAL = 0;
         while(!BFINAL && !error)
         {
-          if(bp >> 3 >= in.size()) { error = 52; return; } //error, bit pointer will jump past memory
-          BFINAL = readBitFromStream(bp, &in[inpos]);
-          unsigned long BTYPE = readBitFromStream(bp, &in[inpos]); BTYPE += 2 * readBitFromStream(bp, &in[inpos]);
+          reader.refill();
+          if(reader.pastEnd()) { error = 52; return; } //error, bit pointer will jump past memory
+          BFINAL = reader.bits(1);
+          unsigned long BTYPE = reader.bits(2);
           if(BTYPE == 3) { error = 20; return; } //error: invalid BTYPE
-          else if(BTYPE == 0) inflateNoCompression(out, &in[inpos], bp, pos, in.size());
-          else inflateHuffmanBlock(out, &in[inpos], bp, pos, in.size(), BTYPE);
+          else if(BTYPE == 0) inflateNoCompression(out, pos);
+          else inflateHuffmanBlock(out, pos, BTYPE);
         }
-        if(!error) out.resize(pos); //Only now we know the true size of out, resize it to that
+        if(error) return;
+        if(sink) error = sink->write(&out[flushed], pos - flushed);
+        else out.resize(pos); //Only now we know the true size of out, resize it to that
+      }
+      void flush(std::vector<unsigned char>& out, size_t& pos) //hands the new bytes to the sink, keeps the last WINDOW bytes
+      {
+        error = sink->write(&out[flushed], pos - flushed); if(error) return;
+        memmove(&out[0], &out[pos - WINDOW], WINDOW);
+        pos = flushed = WINDOW;
       }
       void generateFixedTrees(HuffmanTree& tree, HuffmanTree& treeD) //get the tree of a deflated block with fixed tree
       {
-        std::vector<unsigned long> bitlen(288, 8), bitlenD(32, 5);;
+        unsigned long bitlen[288], bitlenD[32];
+        for(size_t i = 0; i <= 143; i++) bitlen[i] = 8;
         for(size_t i = 144; i <= 255; i++) bitlen[i] = 9;
         for(size_t i = 256; i <= 279; i++) bitlen[i] = 7;
-        tree.makeFromLengths(bitlen, 15);
-        treeD.makeFromLengths(bitlenD, 15);
-      }
-      HuffmanTree codetree, codetreeD, codelengthcodetree; //the code tree for Huffman codes, dist codes, and code length codes
-      unsigned long huffmanDecodeSymbol(const unsigned char* in, size_t& bp, const HuffmanTree& codetree, size_t inlength)
-      { //decode a single symbol from given list of bits with given code tree. return value is the symbol
-        bool decoded; unsigned long ct;
-        for(size_t treepos = 0;;)
-        {
-          if((bp & 0x07) == 0 && (bp >> 3) > inlength) { error = 10; return 0; } //error: end reached without endcode
-          error = codetree.decode(decoded, ct, treepos, readBitFromStream(bp, in)); if(error) return 0; //stop, an error happened
-          if(decoded) return ct;
-        }
+        for(size_t i = 280; i <= 287; i++) bitlen[i] = 8;
+        for(size_t i = 0; i < 32; i++) bitlenD[i] = 5;
+        tree.makeFromLengths(bitlen, 288);
+        treeD.makeFromLengths(bitlenD, 32);
       }
-      void getTreeInflateDynamic(HuffmanTree& tree, HuffmanTree& treeD, const unsigned char* in, size_t& bp, size_t inlength)
+      void getTreeInflateDynamic(HuffmanTree& tree, HuffmanTree& treeD)
       { //get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree
-        std::vector<unsigned long> bitlen(288, 0), bitlenD(32, 0);
-        if(bp >> 3 >= inlength - 2) { error = 49; return; } //the bit pointer is or will go past the memory
-        size_t HLIT =  readBitsFromStream(bp, in, 5) + 257; //number of literal/length codes + 257
-        size_t HDIST = readBitsFromStream(bp, in, 5) + 1; //number of dist codes + 1
-        size_t HCLEN = readBitsFromStream(bp, in, 4) + 4; //number of code length codes + 4
-        std::vector<unsigned long> codelengthcode(19); //lengths of tree to decode the lengths of the dynamic tree
-        for(size_t i = 0; i < 19; i++) codelengthcode[CLCL[i]] = (i < HCLEN) ? readBitsFromStream(bp, in, 3) : 0;
-        error = codelengthcodetree.makeFromLengths(codelengthcode, 7); if(error) return;
+        unsigned long bitlen[288] = {0}, bitlenD[32] = {0}, codelengthcode[19] = {0};
+        reader.refill();
+        size_t HLIT =  reader.bits(5) + 257; //number of literal/length codes + 257
+        size_t HDIST = reader.bits(5) + 1; //number of dist codes + 1
+        size_t HCLEN = reader.bits(4) + 4; //number of code length codes + 4
+        for(size_t i = 0; i < HCLEN; i++) codelengthcode[CLCL[i]] = reader.bits(3); //lengths of tree to decode the lengths of the dynamic tree
+        if(reader.pastEnd()) { error = 49; return; } //the bit pointer is or will go past the memory
+        error = codelengthcodetree.makeFromLengths(codelengthcode, 19); if(error) return;
         size_t i = 0, replength;
         while(i < HLIT + HDIST)
         {
-          unsigned long code = huffmanDecodeSymbol(in, bp, codelengthcodetree, inlength); if(error) return;
+          reader.refill();
+          unsigned long code;
+          error = codelengthcodetree.decode(reader, code); if(error) return;
+          if(reader.pastEnd()) { error = 10; return; } //error: end reached without endcode
           if(code <= 15)  { if(i < HLIT) bitlen[i++] = code; else bitlenD[i++ - HLIT] = code; } //a length code
           else if(code == 16) //repeat previous
           {
-            if(bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-            replength = 3 + readBitsFromStream(bp, in, 2);
+            if(i == 0) { error = 54; return; } //error: there is no previous length to repeat
+            replength = 3 + reader.bits(2);
             unsigned long value; //set value to the previous code
             if((i - 1) < HLIT) value = bitlen[i - 1];
             else value = bitlenD[i - HLIT - 1];
@@ -1318,8 +2067,7 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
           }
           else if(code == 17) //repeat "0" 3-10 times
           {
-            if(bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-            replength = 3 + readBitsFromStream(bp, in, 3);
+            replength = 3 + reader.bits(3);
             for(size_t n = 0; n < replength; n++) //repeat this value in the next lengths
             {
               if(i >= HLIT + HDIST) { error = 14; return; } //error: i is larger than the amount of codes
@@ -1328,8 +2076,7 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
           }
           else if(code == 18) //repeat "0" 11-138 times
           {
-            if(bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-            replength = 11 + readBitsFromStream(bp, in, 7);
+            replength = 11 + reader.bits(7);
             for(size_t n = 0; n < replength; n++) //repeat this value in the next lengths
             {
               if(i >= HLIT + HDIST) { error = 15; return; } //error: i is larger than the amount of codes
@@ -1337,62 +2084,96 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
             }
           }
           else { error = 16; return; } //error: somehow an unexisting code appeared. This can never happen.
+          if(reader.pastEnd()) { error = 50; return; } //error, bit pointer jumps past memory
         }
         if(bitlen[256] == 0) { error = 64; return; } //the length of the end code 256 must be larger than 0
-        error = tree.makeFromLengths(bitlen, 15); if(error) return; //now we've finally got HLIT and HDIST, so generate the code trees, and the function is done
-        error = treeD.makeFromLengths(bitlenD, 15); if(error) return;
+        error = tree.makeFromLengths(bitlen, 288); if(error) return; //now we've finally got HLIT and HDIST, so generate the code trees, and the function is done
+        error = treeD.makeFromLengths(bitlenD, 32); if(error) return;
       }
-      void inflateHuffmanBlock(std::vector<unsigned char>& out, const unsigned char* in, size_t& bp, size_t& pos, size_t inlength, unsigned long btype)
+      void inflateHuffmanBlock(std::vector<unsigned char>& out, size_t& pos, unsigned long btype)
       {
         if(btype == 1) { generateFixedTrees(codetree, codetreeD); }
-        else if(btype == 2) { getTreeInflateDynamic(codetree, codetreeD, in, bp, inlength); if(error) return; }
+        else if(btype == 2) { getTreeInflateDynamic(codetree, codetreeD); if(error) return; }
+        unsigned char* out_ = out.empty() ? 0 : &out[0];
+        size_t outsize = out.size();
         for(;;)
         {
-          unsigned long code = huffmanDecodeSymbol(in, bp, codetree, inlength); if(error) return;
+          if(sink && pos >= WINDOW + FLUSH) { flush(out, pos); if(error) return; } //the window has no room for another match
+          reader.refill(); //one refill is enough for a whole length/distance pair: at most 15 + 5 + 15 + 13 bits
+          unsigned long code;
+          error = codetree.decode(reader, code); if(error) return;
+          if(reader.pastEnd()) { error = 10; return; } //error: end reached without endcode
           if(code == 256) return; //end code
           else if(code <= 255) //literal symbol
           {
-            if(pos >= out.size()) out.resize((pos + 1) * 2); //reserve more room
-            out[pos++] = (unsigned char)(code);
+            if(pos >= outsize) { out.resize((pos + 1) * 2); out_ = &out[0]; outsize = out.size(); } //reserve more room
+            out_[pos++] = (unsigned char)(code);
           }
           else if(code >= 257 && code <= 285) //length code
           {
-            size_t length = LENBASE[code - 257], numextrabits = LENEXTRA[code - 257];
-            if((bp >> 3) >= inlength) { error = 51; return; } //error, bit pointer will jump past memory
-            length += readBitsFromStream(bp, in, numextrabits);
-            unsigned long codeD = huffmanDecodeSymbol(in, bp, codetreeD, inlength); if(error) return;
+            size_t length = LENBASE[code - 257] + reader.bits(LENEXTRA[code - 257]);
+            unsigned long codeD;
+            error = codetreeD.decode(reader, codeD); if(error) return;
             if(codeD > 29) { error = 18; return; } //error: invalid dist code (30-31 are never used)
-            unsigned long dist = DISTBASE[codeD], numextrabitsD = DISTEXTRA[codeD];
-            if((bp >> 3) >= inlength) { error = 51; return; } //error, bit pointer will jump past memory
-            dist += readBitsFromStream(bp, in, numextrabitsD);
-            size_t start = pos, back = start - dist; //backwards
-            if(pos + length >= out.size()) out.resize((pos + length) * 2); //reserve more room
-            for(size_t i = 0; i < length; i++) { out[pos++] = out[back++]; if(back >= start) back = start - dist; }
+            size_t dist = DISTBASE[codeD] + reader.bits(DISTEXTRA[codeD]);
+            if(reader.pastEnd()) { error = 51; return; } //error, bit pointer will jump past memory
+            if(dist > pos) { error = 52; return; } //error: distance points before the start of the output
+            const unsigned char* back = out_ + pos - dist;
+            if(dist >= 8 && pos + length + 8 <= outsize) //fast copy, 8 bytes at a time, may write up to 7 bytes past the match
+            {
+              unsigned char* dest = out_ + pos;
+              for(size_t i = 0; i < length; i += 8) memcpy(dest + i, back + i, 8);
+              pos += length;
+            }
+            else
+            {
+              if(pos + length >= outsize) { out.resize((pos + length) * 2); out_ = &out[0]; outsize = out.size(); back = out_ + pos - dist; } //reserve more room
+              for(size_t i = 0; i < length; i++) out_[pos + i] = back[i]; //overlapping copy repeats the last dist bytes
+              pos += length;
+            }
           }
         }
       }
-      void inflateNoCompression(std::vector<unsigned char>& out, const unsigned char* in, size_t& bp, size_t& pos, size_t inlength)
+      void inflateNoCompression(std::vector<unsigned char>& out, size_t& pos)
       {
-        while((bp & 0x7) != 0) bp++; //go to first boundary of byte
-        size_t p = bp / 8;
-        if(p >= inlength - 4) { error = 52; return; } //error, bit pointer will jump past memory
-        unsigned long LEN = in[p] + 256 * in[p + 1], NLEN = in[p + 2] + 256 * in[p + 3]; p += 4;
+        reader.alignToByte(); //go to first boundary of byte
+        unsigned char header[4];
+        if(!reader.readBytes(header, 4)) { error = 52; return; } //error, bit pointer will jump past memory
+        size_t LEN = header[0] + 256 * header[1], NLEN = header[2] + 256 * header[3];
         if(LEN + NLEN != 65535) { error = 21; return; } //error: NLEN is not one's complement of LEN
-        if(pos + LEN >= out.size()) out.resize(pos + LEN);
-        if(p + LEN > inlength) { error = 23; return; } //error: reading outside of in buffer
-        for(unsigned long n = 0; n < LEN; n++) out[pos++] = in[p++]; //read LEN bytes of literal data
-        bp = p * 8;
+        while(LEN > 0) //read LEN bytes of literal data, in pieces that fit the window when streaming
+        {
+          if(sink && pos >= WINDOW + FLUSH) { flush(out, pos); if(error) return; }
+          size_t n = (sink && WINDOW + FLUSH - pos < LEN) ? WINDOW + FLUSH - pos : LEN;
+          if(pos + n > out.size()) out.resize(pos + n);
+          if(!reader.readBytes(&out[pos], n)) { error = 23; return; } //error: reading outside of in buffer
+          pos += n; LEN -= n;
+        }
       }
     };
     int decompress(std::vector<unsigned char>& out, const std::vector<unsigned char>& in) //returns error value
+    {
+      return decompress(out, in.empty() ? 0 : &in[0], in.size());
+    }
+    int decompress(std::vector<unsigned char>& out, const unsigned char* in, size_t size) //returns error value
+    {
+      Segment segment = { in, size };
+      return decompress(out, &segment, 1);
+    }
+    //decompresses the stream made of the given segments. With a sink, the output is handed to it as it comes and out is
+    //only used as the sliding window, else out gets all of it. Returns error value
+    int decompress(std::vector<unsigned char>& out, const Segment* segments, size_t numSegments, Sink* sink = 0)
     {
       Inflator inflator;
-      if(in.size() < 2) { return 53; } //error, size of zlib data too small
-      if((in[0] * 256 + in[1]) % 31 != 0) { return 24; } //error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way
-      unsigned long CM = in[0] & 15, CINFO = (in[0] >> 4) & 15, FDICT = (in[1] >> 5) & 1;
+      inflator.reader.init(segments, numSegments);
+      if(inflator.reader.total < 2) { return 53; } //error, size of zlib data too small
+      inflator.reader.refill();
+      unsigned long in0 = inflator.reader.bits(8), in1 = inflator.reader.bits(8);
+      if((in0 * 256 + in1) % 31 != 0) { return 24; } //error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way
+      unsigned long CM = in0 & 15, CINFO = (in0 >> 4) & 15, FDICT = (in1 >> 5) & 1;
       if(CM != 8 || CINFO > 7) { return 25; } //error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec
       if(FDICT != 0) { return 26; } //error: the specification of PNG says about the zlib stream: "The additional flags shall not specify a preset dictionary."
-      inflator.inflate(out, in, 2);
+      inflator.inflate(out, sink);
       return inflator.error; //note: adler32 checksum was skipped and ignored
     }
   };
@@ -1405,24 +2186,26 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
       std::vector<unsigned char> palette;
     } info;
     int error;
-    void decode(std::vector<unsigned char>& out, const unsigned char* in, size_t size, bool convert_to_rgba32)
+    std::vector<Uint32> paletteARGB; //the palette converted for convertARGB, made on first use
+    std::vector<unsigned char> rgbaRow; //conversion buffer of convertARGB for the rare color types
+    void readChunks(const unsigned char* in, size_t size, std::vector<Zlib::Segment>& idat) //reads header and chunks, idat gets the compressed data
     {
       error = 0;
       if(size == 0 || in == 0) { error = 48; return; } //the given data is empty
       readPngHeader(&in[0], size); if(error) return;
       size_t pos = 33; //first byte of the first chunk after the header
-      std::vector<unsigned char> idat; //the data from idat chunks
       bool IEND = false, known_type = true;
       info.key_defined = false;
-      while(!IEND) //loop through the chunks, ignoring unknown chunks and stopping at IEND chunk. IDAT data is put at the start of the in buffer
+      while(!IEND) //loop through the chunks, ignoring unknown chunks and stopping at IEND chunk. IDAT data stays where it is in the in buffer
       {
         if(pos + 8 >= size) { error = 30; return; } //error: size of the in buffer too small to contain next chunk
         size_t chunkLength = read32bitInt(&in[pos]); pos += 4;
         if(chunkLength > 2147483647) { error = 63; return; }
-        if(pos + chunkLength >= size) { error = 35; return; } //error: size of the in buffer too small to contain next chunk
+        if(pos + 4 + chunkLength > size) { error = 35; return; } //error: size of the in buffer too small to contain next chunk
         if(in[pos + 0] == 'I' && in[pos + 1] == 'D' && in[pos + 2] == 'A' && in[pos + 3] == 'T') //IDAT chunk, containing compressed image data
         {
-          idat.insert(idat.end(), &in[pos + 4], &in[pos + 4 + chunkLength]);
+          Zlib::Segment segment = { &in[pos + 4], chunkLength };
+          idat.push_back(segment);
           pos += (4 + chunkLength);
         }
         else if(in[pos + 0] == 'I' && in[pos + 1] == 'E' && in[pos + 2] == 'N' && in[pos + 3] == 'D')  { pos += 4; IEND = true; }
@@ -1468,10 +2251,16 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
         }
         pos += 4; //step over CRC (which is ignored)
       }
+    }
+    void decode(std::vector<unsigned char>& out, const unsigned char* in, size_t size, bool convert_to_rgba32)
+    {
+      std::vector<Zlib::Segment> idat; //where the compressed data is in the in buffer
+      readChunks(in, size, idat); if(error) return;
       unsigned long bpp = getBpp(info);
       std::vector<unsigned char> scanlines(((info.width * (info.height * bpp + 7)) / 8) + info.height); //now the out buffer will be filled
       Zlib zlib; //decompress with the Zlib decompressor
-      error = zlib.decompress(scanlines, idat); if(error) return; //stop if the zlib decompressor returned an error
+      error = zlib.decompress(scanlines, idat.empty() ? 0 : &idat[0], idat.size()); if(error) return; //stop if the zlib decompressor returned an error
+      if(scanlines.size() < imageDataSize(bpp)) { error = 91; return; } //error: the image data ends before the last scanline
       size_t bytewidth = (bpp + 7) / 8, outlength = (info.height * info.width * bpp + 7) / 8;
       out.resize(outlength); //time to fill the out buffer
       unsigned char* out_ = outlength ? &out[0] : 0; //use a regular pointer to the std::vector for faster code if compiled without optimization
@@ -1488,21 +2277,22 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
         }
         else //less than 8 bits per pixel, so fill it up bit per bit
         {
-          std::vector<unsigned char> templine((info.width * bpp + 7) >> 3); //only used if bpp < 8
+          std::vector<unsigned char> templine((info.width * bpp + 7) >> 3), prevtemp(templine.size()); //only used if bpp < 8
           for(size_t y = 0, obp = 0; y < info.height; y++)
           {
             unsigned long filterType = scanlines[linestart];
-            const unsigned char* prevline = (y == 0) ? 0 : &out_[(y - 1) * info.width * bytewidth];
+            const unsigned char* prevline = (y == 0) ? 0 : &prevtemp[0]; //the previous line unfiltered, out_ is bit packed without line padding
             unFilterScanline(&templine[0], &scanlines[linestart + 1], prevline, bytewidth, filterType, linelength); if(error) return;
             for(size_t bp = 0; bp < info.width * bpp;) setBitOfReversedStream(obp, out_, readBitFromReversedStream(bp, &templine[0]));
+            templine.swap(prevtemp);
             linestart += (1 + linelength); //go to start of next scanline
           }
         }
       }
       else //interlaceMethod is 1 (Adam7)
       {
-        size_t passw[7] = { (info.width + 7) / 8, (info.width + 3) / 8, (info.width + 3) / 4, (info.width + 1) / 4, (info.width + 1) / 2, (info.width + 0) / 2, (info.width + 0) / 1 };
-        size_t passh[7] = { (info.height + 7) / 8, (info.height + 7) / 8, (info.height + 3) / 8, (info.height + 3) / 4, (info.height + 1) / 4, (info.height + 1) / 2, (info.height + 0) / 2 };
+        size_t passw[7], passh[7];
+        adam7Sizes(passw, passh);
         size_t passstart[7] = {0};
         size_t pattern[28] = {0,4,0,2,0,1,0,0,0,4,0,2,0,1,8,8,4,4,2,2,1,8,8,8,4,4,2,2}; //values for the adam7 passes
         for(int i = 0; i < 6; i++) passstart[i + 1] = passstart[i] + passh[i] * ((passw[i] ? 1 : 0) + (passw[i] * bpp + 7) / 8);
@@ -1512,9 +2302,96 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
       }
       if(convert_to_rgba32 && (info.colorType != 6 || info.bitDepth != 8)) //conversion needed
       {
-        std::vector<unsigned char> data = out;
-        error = convert(out, &data[0], info, info.width, info.height);
+        std::vector<unsigned char> data;
+        data.swap(out); //convert writes a new out from the unconverted pixels
+        error = convert(out, data.empty() ? 0 : &data[0], info, info.width, info.height);
+      }
+    }
+    void adam7Sizes(size_t* passw, size_t* passh) const //the size in pixels of each of the 7 interlace passes
+    {
+      const unsigned long w = info.width, h = info.height;
+      const size_t pw[7] = { (w + 7) / 8, (w + 3) / 8, (w + 3) / 4, (w + 1) / 4, (w + 1) / 2, (w + 0) / 2, (w + 0) / 1 };
+      const size_t ph[7] = { (h + 7) / 8, (h + 7) / 8, (h + 3) / 8, (h + 3) / 4, (h + 1) / 4, (h + 1) / 2, (h + 0) / 2 };
+      for(int i = 0; i < 7; i++) { passw[i] = pw[i]; passh[i] = ph[i]; }
+    }
+    size_t imageDataSize(unsigned long bpp) const //bytes of filtered scanlines the zlib data must hold
+    {
+      if(info.interlaceMethod == 0) return info.height * (1 + (info.width * bpp + 7) / 8);
+      size_t passw[7], passh[7], size = 0;
+      adam7Sizes(passw, passh);
+      for(int i = 0; i < 7; i++) if(passw[i]) size += passh[i] * (1 + (passw[i] * bpp + 7) / 8);
+      return size;
+    }
+    struct RowDecoder : Zlib::Sink //unfilters and converts the image row by row while it's inflated, with two scanlines of memory
+    {
+      PNG& png;
+      Uint32* out; //the final image
+      unsigned long bpp;
+      size_t bytewidth, pass, passw, passh, row, linelength, fill;
+      std::vector<unsigned char> line, prev; //the scanline being filled, filter type byte first, and the one above it
+      std::vector<Uint32> pixels; //a converted row of an Adam7 pass, before it's spread over the image
+      RowDecoder(PNG& png, Uint32* out) : png(png), out(out), bpp(png.getBpp(png.info)), bytewidth((bpp + 7) / 8), pass(0), row(0), fill(0)
+      {
+        if(png.info.interlaceMethod == 0) { passw = png.info.width; passh = png.info.height; startPass(); }
+        else { pass = size_t(-1); nextPass(); }
+      }
+      bool done() const { return pass >= 7 || (png.info.interlaceMethod == 0 && row == passh); }
+      void startPass()
+      {
+        linelength = (passw * bpp + 7) / 8;
+        line.resize(linelength + 1); prev.resize(linelength + 1);
+        if(png.info.interlaceMethod != 0) pixels.resize(passw);
+        row = 0; fill = 0;
+      }
+      void nextPass() //go to the next Adam7 pass that has pixels, empty passes have no data at all
+      {
+        size_t pw[7], ph[7];
+        png.adam7Sizes(pw, ph);
+        for(pass++; pass < 7; pass++) if(pw[pass] && ph[pass]) { passw = pw[pass]; passh = ph[pass]; startPass(); return; }
+      }
+      int write(const unsigned char* data, size_t size)
+      {
+        while(size > 0 && !done()) //data after the last row is ignored
+        {
+          size_t n = (size < linelength + 1 - fill) ? size : linelength + 1 - fill;
+          memcpy(&line[fill], data, n);
+          fill += n; data += n; size -= n;
+          if(fill == linelength + 1) { int result = finishRow(); if(result) return result; }
+        }
+        return 0;
+      }
+      int finishRow()
+      {
+        png.unFilterScanline(&line[1], &line[1], row == 0 ? 0 : &prev[1], bytewidth, line[0], linelength); //in place
+        if(png.error) return png.error;
+        if(png.info.interlaceMethod == 0)
+        {
+          int result = png.convertARGB(out + row * passw, &line[1], png.info, passw, 1); if(result) return result;
+        }
+        else
+        {
+          static const size_t passleft[7] = {0, 4, 0, 2, 0, 1, 0}, passtop[7] = {0, 0, 4, 0, 2, 0, 1};
+          static const size_t spacex[7] = {8, 8, 4, 4, 2, 2, 1}, spacey[7] = {8, 8, 8, 4, 4, 2, 2};
+          int result = png.convertARGB(&pixels[0], &line[1], png.info, passw, 1); if(result) return result;
+          Uint32* dest = out + (passtop[pass] + row * spacey[pass]) * png.info.width + passleft[pass];
+          for(size_t x = 0; x < passw; x++) dest[x * spacex[pass]] = pixels[x];
+        }
+        line.swap(prev);
+        fill = 0;
+        if(++row == passh && png.info.interlaceMethod != 0) nextPass();
+        return 0;
       }
+    };
+    void decodeARGB(std::vector<Uint32>& out, const unsigned char* in, size_t size) //decodes straight into ARGB pixels, row by row
+    {
+      std::vector<Zlib::Segment> idat; //where the compressed data is in the in buffer
+      readChunks(in, size, idat); if(error) return;
+      out.resize(info.width * info.height);
+      RowDecoder rows(*this, out.empty() ? 0 : &out[0]);
+      std::vector<unsigned char> window;
+      Zlib zlib;
+      error = zlib.decompress(window, idat.empty() ? 0 : &idat[0], idat.size(), &rows); if(error) return;
+      if(!rows.done()) error = 91; //error: the image data ends before the last scanline
     }
     void readPngHeader(const unsigned char* in, size_t inlength) //read the information from the header and store it in the Info
     {
@@ -1530,6 +2407,7 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
     }
     void unFilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t bytewidth, unsigned long filterType, size_t length)
     {
+      if(unFilterScanlineSIMD(recon, scanline, precon, bytewidth, filterType, length)) return;
       switch(filterType)
       {
         case 0: for(size_t i = 0; i < length; i++) recon[i] = scanline[i]; break;
@@ -1642,7 +2520,7 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
       for(size_t i = 0; i < numpixels; i++)
       {
         out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[2 * i];
-        out_[4 * i + 3] = (infoIn.key_defined && 256U * in[i] + in[i + 1] == infoIn.key_r) ? 0 : 255;
+        out_[4 * i + 3] = (infoIn.key_defined && 256U * in[2 * i] + in[2 * i + 1] == infoIn.key_r) ? 0 : 255;
       }
       else if(infoIn.bitDepth == 16 && infoIn.colorType == 2) //RGB color
       for(size_t i = 0; i < numpixels; i++)
@@ -1673,17 +2551,54 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
       }
       return 0;
     }
+    int convertARGB(Uint32* out, const unsigned char* in, Info& infoIn, unsigned long w, unsigned long h)
+    { //converts from any color type to the ARGB pixels of loadImage in one pass for the common ones. return value = LodePNG error code
+      size_t numpixels = w * h;
+      if(infoIn.bitDepth == 8 && infoIn.colorType == 6) convertRGBAtoARGB(out, in, numpixels);
+      else if(infoIn.bitDepth == 8 && infoIn.colorType == 2 && !infoIn.key_defined) convertRGBtoARGB(out, in, numpixels);
+      else if(infoIn.bitDepth == 8 && infoIn.colorType == 0 && !infoIn.key_defined) convertGreyToARGB(out, in, numpixels);
+      else if(infoIn.bitDepth == 8 && infoIn.colorType == 4) convertGreyAlphaToARGB(out, in, numpixels);
+      else if(infoIn.bitDepth == 8 && infoIn.colorType == 3) //indexed color, through the palette converted once
+      {
+        size_t colors = infoIn.palette.size() / 4;
+        if(paletteARGB.size() != colors) { paletteARGB.resize(colors); if(colors) convertRGBAtoARGB(&paletteARGB[0], &infoIn.palette[0], colors); }
+        for(size_t i = 0; i < numpixels; i++)
+        {
+          if(in[i] >= colors) return 46;
+          out[i] = paletteARGB[in[i]];
+        }
+      }
+      else //the rare ones: color keys, 16 bits and less than 8 bits
+      {
+        int result = convert(rgbaRow, in, infoIn, w, h); if(result) return result;
+        convertRGBAtoARGB(out, &rgbaRow[0], numpixels);
+      }
+      return 0;
+    }
     unsigned char paethPredictor(short a, short b, short c) //Paeth predicter, used by PNG filter type 4
     {
       short p = a + b - c, pa = p > a ? (p - a) : (a - p), pb = p > b ? (p - b) : (b - p), pc = p > c ? (p - c) : (c - p);
       return (unsigned char)((pa <= pb && pa <= pc) ? a : pb <= pc ? b : c);
     }
   };
-  PNG decoder; decoder.decode(out_image, in_png, in_size, convert_to_rgba32);
+  PNG decoder;
+  if(out_argb) decoder.decodeARGB(*out_argb, in_png, in_size);
+  else decoder.decode(out_image, in_png, in_size, convert_to_rgba32);
   image_width = decoder.info.width; image_height = decoder.info.height;
   return decoder.error;
 }
 
+int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32)
+{
+  return decodePNG(out_image, 0, image_width, image_height, in_png, in_size, convert_to_rgba32);
+}
+
+int decodePNG(std::vector<Uint32>& out_argb, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size)
+{
+  std::vector<unsigned char> unused;
+  return decodePNG(unused, &out_argb, image_width, image_height, in_png, in_size, false);
+}
+
 int decodePNG(std::vector<unsigned char>& out_image_32bit, unsigned long& image_width, unsigned long& image_height, const std::vector<unsigned char>& in_png)
 {
   return decodePNG(out_image_32bit, image_width, image_height, in_png.size() ? &in_png[0] : 0, in_png.size());
@@ -1694,7 +2609,7 @@ int decodePNG(std::vector<unsigned char>& out_image_32bit, unsigned long& image_
 ////////////////////////////////////////////////////////////////////////////////
 
 
-bool font[256][8][8];
+Uint8 font[256][8]; //bit-packed rows, bit x is column x
 struct GenerateFont
 {
   GenerateFont()
@@ -1734,9 +2649,10 @@ QtOibS8BEX/cffjo+7IAAAAASUVORK5CYII=";
     decodePNG(image, w, h, &png[0], png.size());
     for(size_t c = 0; c < 256; c++)
     for(size_t y = 0; y < 8; y++)
-    for(size_t x = 0; x < 8; x++)
     {
-      font[c][x][y] = image[4 * 128 * (8 * (c / 16) + y) + 4 * (8 * (c % 16) + x)] != 0;
+      font[c][y] = 0;
+      for(size_t x = 0; x < 8; x++)
+        if(image[4 * 128 * (8 * (c / 16) + y) + 4 * (8 * (c % 16) + x)] != 0) font[c][y] |= 1 << x;
     }
   }
 };
@@ -200,8 +200,26 @@ void cls(const ColorRGB& color = RGB_Black);
 void pset(int x, int y, const ColorRGB& color);
 ColorRGB pget(int x, int y);
 void drawBuffer(Uint32* buffer);
+void drawBuffer(const Uint16* buffer); //RGB565 pixels, expanded to 32-bit while they are copied
+void drawBuffer(const Uint8* buffer, const Uint32* palette); //indices into 256 colors, looked up while they are copied
 bool onScreen(int x, int y);
 
+//a block of 32-bit pixels to draw into, such as the buffer given to drawBuffer. pitch is in pixels, not bytes
+struct Canvas
+{
+  Uint32* pixels;
+  int width;
+  int height;
+  int pitch;
+
+  Canvas(Uint32* pixels, int width, int height);
+  Canvas(Uint32* pixels, int width, int height, int pitch);
+};
+Canvas screenCanvas(); //the screen surface itself, only valid until the next screen() call
+
+//RGB565 packing of a 32-bit color, the format of drawBuffer(const Uint16*)
+inline Uint16 toRGB565(Uint32 color) { return Uint16(((color >> 8) & 0xF800) | ((color >> 5) & 0x07E0) | ((color >> 3) & 0x001F)); }
+
 ////////////////////////////////////////////////////////////////////////////////
 //NON GRAPHICAL FUNCTIONS///////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -229,6 +247,48 @@ bool drawDisk(int xc, int yc, int radius, const ColorRGB& color);
 bool drawRect(int x1, int y1, int x2, int y2, const ColorRGB& color);
 bool clipLine(int x1,int y1,int x2, int y2, int & x3, int & y3, int & x4, int & y4);
 
+//the same shapes drawn into a canvas. Each shape is clipped once against the canvas and then written
+//as runs of pixels, without per pixel checks. They return false if no pixel of the shape is on the canvas
+void fillSpan(Uint32* pixels, int count, Uint32 color);
+bool horLine(const Canvas& canvas, int y, int x1, int x2, Uint32 color);
+bool verLine(const Canvas& canvas, int x, int y1, int y2, Uint32 color);
+bool drawLine(const Canvas& canvas, int x1, int y1, int x2, int y2, Uint32 color);
+bool drawCircle(const Canvas& canvas, int xc, int yc, int radius, Uint32 color);
+bool drawDisk(const Canvas& canvas, int xc, int yc, int radius, Uint32 color);
+bool drawRect(const Canvas& canvas, int x1, int y1, int x2, int y2, Uint32 color);
+bool blendRect(const Canvas& canvas, int x1, int y1, int x2, int y2, Uint32 color, int alpha); //alpha from 0 (invisible) to 256 (opaque)
+bool clipLine(int width, int height, int x1, int y1, int x2, int y2, int& x3, int& y3, int& x4, int& y4);
+
+//records shapes and text and draws them all in one go, in the order they were added
+class DrawList
+{
+  public:
+  void horLine(int y, int x1, int x2, Uint32 color);
+  void verLine(int x, int y1, int y2, Uint32 color);
+  void drawLine(int x1, int y1, int x2, int y2, Uint32 color);
+  void drawCircle(int xc, int yc, int radius, Uint32 color);
+  void drawDisk(int xc, int yc, int radius, Uint32 color);
+  void drawRect(int x1, int y1, int x2, int y2, Uint32 color);
+  void blendRect(int x1, int y1, int x2, int y2, Uint32 color, int alpha);
+  void printString(const std::string& text, int x, int y, Uint32 color, bool bg = 0, Uint32 color2 = 0, int scale = 1);
+  void draw(const Canvas& canvas) const;
+  void clear();
+  size_t size() const { return commands.size(); }
+
+  private:
+  enum Type { HOR_LINE, VER_LINE, LINE, CIRCLE, DISK, RECT, BLEND_RECT, TEXT };
+  struct Command
+  {
+    Type type;
+    int a, b, c, d; //coordinates, meaning depends on the type
+    int extra; //alpha, or scale and background flag for text
+    Uint32 color, color2;
+  };
+  void add(Type type, int a, int b, int c, int d, Uint32 color, int extra = 0, Uint32 color2 = 0);
+  std::vector<Command> commands;
+  std::string chars; //text of all TEXT commands, c and d are the range in here
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //COLOR CONVERSIONS/////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -246,6 +306,33 @@ ColorRGB INTtoRGB(Uint32 colorINT);
 void loadFile(std::vector<unsigned char>& buffer, const std::string& filename);
 void saveFile(const std::vector<unsigned char>& buffer, const std::string& filename);
 
+//read-only or copy-on-write view of a whole file: mapped into memory where the system can, else read into a buffer with stdio.
+//data() stays valid until close() or destruction. Empty or missing files give data() == 0 and size() == 0.
+class MappedFile
+{
+  public:
+  enum Access { ACCESS_NORMAL, ACCESS_SEQUENTIAL, ACCESS_RANDOM, ACCESS_WILLNEED }; //madvise hint for the mapping
+  MappedFile() : data_(0), size_(0), mapped(false), writable(false) {}
+  MappedFile(const std::string& filename, Access access = ACCESS_SEQUENTIAL) : data_(0), size_(0), mapped(false), writable(false) { open(filename, access); }
+  ~MappedFile() { close(); }
+  //returns false if the file can't be read. With copyOnWrite the contents can be changed through writableData(): pages are
+  //shared with every other mapping of the file until written, and the changes never reach the file
+  bool open(const std::string& filename, Access access = ACCESS_SEQUENTIAL, bool copyOnWrite = false);
+  void close();
+  const unsigned char* data() const { return data_; }
+  unsigned char* writableData() { return writable ? data_ : 0; } //0 unless opened copyOnWrite
+  size_t size() const { return size_; }
+  bool isMapped() const { return mapped; }
+  private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+  unsigned char* data_;
+  size_t size_;
+  bool mapped;
+  bool writable;
+  std::vector<unsigned char> buffer; //the contents when the file couldn't be mapped
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //IMAGE FUNCTIONS///////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -254,14 +341,54 @@ int loadImage(std::vector<ColorRGB>& out, unsigned long& w, unsigned long& h, co
 int loadImage(std::vector<Uint32>& out, unsigned long& w, unsigned long& h, const std::string& filename);
 int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32 = true);
 int decodePNG(std::vector<unsigned char>& out_image_32bit, unsigned long& image_width, unsigned long& image_height, const std::vector<unsigned char>& in_png);
+int decodePNG(std::vector<Uint32>& out_argb, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size); //straight to the 0xAARRGGBB pixels of loadImage
+
+//one image of a batch load: the caller fills in slot and filename, loadImages fills in the rest
+struct ImageRequest
+{
+  ImageRequest(int slot = 0, const std::string& filename = "") : slot(slot), filename(filename), w(0), h(0), error(0) {}
+  int slot; //the image goes into out[slot]
+  std::string filename;
+  unsigned long w, h;
+  int error; //0 if it loaded, else the decodePNG error code (48 if the file is missing or empty)
+};
+//loads the images of all requests into out[slot], reading and decoding them on several threads. A file requested for several
+//slots is decoded only once. threads = 0 uses one per core. Returns the number of requests that failed.
+int loadImages(std::vector<Uint32>* out, std::vector<ImageRequest>& requests, int threads = 0);
 
 ////////////////////////////////////////////////////////////////////////////////
 //TEXT FUNCTIONS////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
-extern bool font[256][8][8];
+extern Uint8 font[256][8]; //8x8 glyphs, one byte per row, bit x of a row is the pixel in column x
 void drawLetter(unsigned char n, int x, int y, const ColorRGB& color = RGB_White, bool bg = 0, const ColorRGB& color2 = RGB_Black);
 int printString(const std::string& text, int x = 0, int y = 0, const ColorRGB& color = RGB_White, bool bg = 0, const ColorRGB& color2 = RGB_Black, int forceLength = 0);
 
+//text straight into a canvas, clipped to its edges. scale > 1 draws glyphs that many times bigger (at most 8)
+//these return the x coordinate right after the drawn text
+int drawLetter(const Canvas& canvas, unsigned char n, int x, int y, Uint32 color, bool bg = 0, Uint32 color2 = 0, int scale = 1);
+int printString(const Canvas& canvas, const std::string& text, int x, int y, Uint32 color, bool bg = 0, Uint32 color2 = 0, int scale = 1);
+
+//collects strings and draws them all at once, e.g. the lines of a debug view
+class TextBatch
+{
+  public:
+  void add(const std::string& text, int x, int y, Uint32 color, bool bg = 0, Uint32 color2 = 0, int scale = 1);
+  void draw(const Canvas& canvas) const;
+  void clear();
+  size_t size() const { return items.size(); }
+
+  private:
+  struct Item
+  {
+    size_t begin, end; //range in chars
+    int x, y, scale;
+    Uint32 color, color2;
+    bool bg;
+  };
+  std::vector<Item> items;
+  std::string chars;
+};
+
 //print something (string, int, float, ...)
 template<typename T>
 int print(const T& val, int x = 0, int y = 0, const ColorRGB& color = RGB_White, bool bg = 0, const ColorRGB& color2 = RGB_Black, int forceLength = 0)
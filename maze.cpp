@@ -6,12 +6,27 @@
  * @date 2023-01-04
  */
 
+#include <algorithm>
 #include <cmath>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <map>
 
 #include "lib/quickcg.h"
+#include "project/src/framebuffer/pixel_format.hpp"
+#include "project/src/lighting/lightmap.hpp"
+#include "project/src/minimap/minimap.hpp"
+#include "project/src/shading/shading.hpp"
+#include "project/src/overlay/overlay.hpp"
+#include "project/src/textures/texture_cache.hpp"
+#include "project/src/textures/texture_pack.hpp"
+#include "project/src/textures/texture_residency.hpp"
+#include "project/src/world/chunked_world.hpp"
+#include "project/src/world/map_edits.hpp"
+#include "project/src/world/map_file.hpp"
+#include "project/src/world/visible_sets.hpp"
+#include "project/src/world/world_map.hpp"
 
 using namespace QuickCG;
 
@@ -21,10 +36,37 @@ using namespace QuickCG;
 #define texHeight 64
 #define mapWidth 24
 #define mapHeight 24
+#define PLACEHOLDER_COLOR 0x404040   // drawn where a texture is still loading
+#define TEXTURE_BUDGET (1 << 20)     // bytes of decoded textures kept resident
+#define PREFETCH_CELLS 6             // how far ahead textures are prefetched
+#define CHUNK_BUDGET (4 << 20)       // bytes of chunks kept in memory when the world is streamed
+#define PALETTE_ERROR 2.0            // RMS error a texture may get from going 8-bit, negative keeps them 32-bit
+#define DRAW_DISTANCE 24.0           // rays and floor rows stop here, in cells
+#define FOG_START 16.0               // the shading fades to the fog color from here to the draw distance
+#define FOG_COLOR 0x000000           // what is beyond the draw distance, the shading fades to black
+#define SHADE_FALLOFF 0.12           // light = 1 / (1 + SHADE_FALLOFF * distance)
+#define SHADE_MIN 0.2                // light of the far bands
+#define SHADE_SIDE 0.5               // light of y-sides relative to x-sides
+#define AMBIENT_LIGHT 0.6            // baked light away from every light, 1 is full light
+#define LIGHT_RADIUS 6.0             // cells a light reaches
+#define VISIBILITY_BAKES 2           // visible sets baked per frame, around the camera
+#define LIGHT_INTENSITY 0.9          // light added right next to a light
+#define LIGHT_TEXTURE 10             // sprites with this texture are lights
+#define NUM_TEXTURES 11
 
 // #define GEN_TEXTURES
+// #define FRAMEBUFFER_RGB565 // render 16-bit pixels, half the memory traffic of the render passes
+// #define FRAMEBUFFER_INDEX8 // render 8-bit indices into a color cube, a quarter of it
 
-// World map
+#if defined(FRAMEBUFFER_RGB565)
+typedef maze::PixelRGB565 Format;
+#elif defined(FRAMEBUFFER_INDEX8)
+typedef maze::PixelIndex8 Format;
+#else
+typedef maze::PixelARGB32 Format;
+#endif
+
+// World map, used when no map file loads
 int worldMap[mapWidth][mapHeight] =
     {
         {8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 4, 4, 6, 4, 4, 6, 4, 6, 4, 4, 4, 6, 4},
@@ -60,7 +102,8 @@ struct Sprite
 
 #define NUM_SPRITES 19
 
-Sprite sprite[NUM_SPRITES] =
+// Sprites of the built-in map
+Sprite builtinSprites[NUM_SPRITES] =
   {
     /** Section 1*/
     {20.5, 11.5, 10},
@@ -90,15 +133,11 @@ Sprite sprite[NUM_SPRITES] =
     {10.5, 15.8,8},
 };
 
-Uint32 buffer[SCREEN_HEIGHT][SCREEN_WIDTH]; /* H ==> W*/
+Format::Type buffer[SCREEN_HEIGHT][SCREEN_WIDTH]; /* H ==> W*/
 
 /* 1D Zbuffer*/
 double ZBuffer[SCREEN_WIDTH];
 
-/* Arrays for sorting sprites*/
-int spriteOrder[NUM_SPRITES];
-double spriteDistance[NUM_SPRITES];
-
 /* Functions for sorting the sprites */
 void sortSprites(int* order, double *dist, int amount);
 
@@ -111,14 +150,85 @@ int main(int ac, char **av, char **env)
   double time = 0;    // time of current frame
   double oldTime = 0; // time of previous frame
 
-  std::vector<Uint32> texture[11];
-  for (int i = 0; i < 11; i++)
-    texture[i].resize(texWidth * texHeight);
+  maze::Overlay overlay; // performance overlay, toggled with F1
+  maze::Minimap minimap; // top-down map, toggled with M
+
+  // the map, a byte per cell in 8x8 tiles, and a bit per cell for the rays
+  maze::MapFile mapFile; // baked by `make maps`, used in place where it is mapped
+  // chunk files, for worlds too big for memory: read as the camera gets to them
+  maze::ChunkedWorld streamed(CHUNK_BUDGET);
+  const char *mapPath = ac > 1 ? av[1] : "maps/level1.map";
+  bool streaming = !mapFile.open(mapPath) && streamed.open(mapPath);
+  if (!mapFile.isOpen() && !streaming)
+    std::cerr << mapPath << ": no usable map file, playing the built-in map" << std::endl;
+  // a streamed world has no whole map: the lightmap and minimap get the built-in one, with no lights and hidden
+  maze::WorldMap builtinWorld(worldMap[0], mapWidth, mapHeight);
+  maze::WorldMap &world = mapFile.isOpen() ? mapFile.map() : builtinWorld;
+  maze::MapEdits edits; // doors and broken walls, made at the start of the next frame
+  std::map<std::pair<int, int>, Uint8> opened; // walls opened with E, and their values to close them again
+
+  if (mapFile.isOpen() || streaming)
+  {
+    double spawnX = mapFile.isOpen() ? mapFile.header().spawnX : streamed.header().spawnX;
+    double spawnY = mapFile.isOpen() ? mapFile.header().spawnY : streamed.header().spawnY;
+    double spawnDirX = mapFile.isOpen() ? mapFile.header().spawnDirX : streamed.header().spawnDirX;
+    double spawnDirY = mapFile.isOpen() ? mapFile.header().spawnDirY : streamed.header().spawnDirY;
+    double length = std::sqrt(spawnDirX * spawnDirX + spawnDirY * spawnDirY);
+    posX = spawnX;
+    posY = spawnY;
+    dirX = spawnDirX / length;
+    dirY = spawnDirY / length;
+    planeX = dirY * 0.66; // the plane is at the right of the direction, as in the built-in start
+    planeY = -dirX * 0.66;
+  }
+
+  std::vector<Sprite> sprite;
+  if (mapFile.isOpen())
+  {
+    for (int i = 0; i < mapFile.spriteCount(); i++)
+    {
+      const maze::MapSprite &s = mapFile.sprites()[i];
+      if (s.texture < NUM_TEXTURES) // checked once here, the sprite pass trusts them
+      {
+        Sprite loaded = {s.x, s.y, int(s.texture)};
+        sprite.push_back(loaded);
+      }
+    }
+  }
+  else if (!streaming) // chunk files have no sprites
+    sprite.assign(builtinSprites, builtinSprites + NUM_SPRITES);
+  int numSprites = int(sprite.size());
+  std::vector<int> spriteOrder(numSprites); // for sorting the sprites
+  std::vector<double> spriteDistance(numSprites);
+
+  maze::TextureCache textures;   // decoded images, shared by the slots that use the same one
+  maze::TexturePack pack;        // precompiled textures, used instead of the PNGs when present
+  pack.open("pics/textures.pak"); // baked by `make pack`, decoded and mapped as is
+  // texture slots, loaded in the background the first time they are needed
+  maze::TextureResidency residency(textures, &pack, texWidth, texHeight, PLACEHOLDER_COLOR, TEXTURE_BUDGET);
+  residency.setPaletteError(PALETTE_ERROR);
+  // distance bands, and their colormaps for every paletted texture
+  maze::Shading shading(DRAW_DISTANCE, SHADE_FALLOFF, SHADE_MIN, SHADE_SIDE, FOG_START);
+  maze::ShadeTables<Format> shadeTables(shading, NUM_TEXTURES);
+  // rays reach past the draw distance at the edges of the view
+  const double viewReach = DRAW_DISTANCE * std::sqrt(1 + 0.66 * 0.66);
+  // light of every cell and wall face in view reach, baked from the light sprites as the camera comes near
+  maze::Lightmap lightmap(world, AMBIENT_LIGHT, LIGHT_RADIUS, viewReach);
+  for (int i = 0; i < numSprites; i++)
+    if (sprite[i].texture == LIGHT_TEXTURE)
+      lightmap.addLight(sprite[i].x, sprite[i].y, LIGHT_INTENSITY);
+  // the regions each region of the map can see, to skip the sprites the camera can't; baked around the camera as it goes
+  maze::VisibleSets visibleSets(world, viewReach);
 
   screen(SCREEN_WIDTH, SCREEN_HEIGHT, 0, "The Maze 1");
+  Format::init();
+  const Format::Type fog = Format::pack(FOG_COLOR);
 
 // Generate textures
 #ifdef GEN_TEXTURES
+  std::vector<Uint32> generated[NUM_TEXTURES];
+  for (int i = 0; i < NUM_TEXTURES; i++)
+    generated[i].resize(texWidth * texHeight);
   for (int x = 0; x < texWidth; ++x)
   {
     for (int y = 0; y < texHeight; ++y)
@@ -127,55 +237,86 @@ int main(int ac, char **av, char **env)
       // int xcolor = x * 256 / texWidth;
       int ycolor = y * 256 / texHeight;
       int xycolor = y * 128 / texHeight + x * 128 / texWidth;
-      texture[0][texWidth * y + x] = 65536 * 254 * (x != y && x != texWidth - y);  // flat red texture with black cross
-      texture[1][texWidth * y + x] = xycolor + 256 * xycolor + 65536 * xycolor;    // sloped greyscale
-      texture[2][texWidth * y + x] = 256 * xycolor + 65536 * xycolor;              // sloped yellow gradient
-      texture[3][texWidth * y + x] = xorcolor + 256 * xorcolor + 65536 * xorcolor; // xor greyscale
-      texture[4][texWidth * y + x] = 256 * xorcolor;                               // xor green
-      texture[5][texWidth * y + x] = 65536 * 192 * (x % 16 && y % 16);             // red bricks
-      texture[6][texWidth * y + x] = 65536 * ycolor;                               // red gradient
-      texture[7][texWidth * y + x] = 128 + 256 * 128 + 65536 * 128;                // flat grey texture
+      generated[0][texWidth * y + x] = 65536 * 254 * (x != y && x != texWidth - y);  // flat red texture with black cross
+      generated[1][texWidth * y + x] = xycolor + 256 * xycolor + 65536 * xycolor;    // sloped greyscale
+      generated[2][texWidth * y + x] = 256 * xycolor + 65536 * xycolor;              // sloped yellow gradient
+      generated[3][texWidth * y + x] = xorcolor + 256 * xorcolor + 65536 * xorcolor; // xor greyscale
+      generated[4][texWidth * y + x] = 256 * xorcolor;                               // xor green
+      generated[5][texWidth * y + x] = 65536 * 192 * (x % 16 && y % 16);             // red bricks
+      generated[6][texWidth * y + x] = 65536 * ycolor;                               // red gradient
+      generated[7][texWidth * y + x] = 128 + 256 * 128 + 65536 * 128;                // flat grey texture
 
       /* Sprite textures*/
-      texture[8][texWidth * y + x] = 65536 * 254 * (x != y && x != texWidth - y);  // flat red texture with black cross
-      texture[9][texWidth * y + x] = xycolor + 256 * xycolor + 65536 * xycolor;    // sloped greyscale
-      texture[10][texWidth * y + x] = 256 * xycolor + 65536 * xycolor;             // sloped yellow gradient
+      generated[8][texWidth * y + x] = 65536 * 254 * (x != y && x != texWidth - y);  // flat red texture with black cross
+      generated[9][texWidth * y + x] = xycolor + 256 * xycolor + 65536 * xycolor;    // sloped greyscale
+      generated[10][texWidth * y + x] = 256 * xycolor + 65536 * xycolor;             // sloped yellow gradient
     }
   }
+  for (int i = 0; i < NUM_TEXTURES; i++)
+    residency.addSlot(textures.pixels(textures.add(generated[i], texWidth, texHeight)));
 #else
-  // generate some textures
-  unsigned long tw, th, error = 0;
-  error |= loadImage(texture[0], tw, th, "pics/bluestone.png");
-  error |= loadImage(texture[1], tw, th, "pics/wood.png");
-  error |= loadImage(texture[2], tw, th, "pics/wood.png");
-  error |= loadImage(texture[3], tw, th, "pics/wood.png");
-  error |= loadImage(texture[4], tw, th, "pics/wood.png");
-  error |= loadImage(texture[5], tw, th, "pics/wood.png");
-  error |= loadImage(texture[6], tw, th, "pics/wood.png");
-  error |= loadImage(texture[7], tw, th, "pics/wood.png");
-  if(error) {
-    std::cout << "Error loading textures" << std::endl;
-    return 1;
-  }
-
-  /* Sprite textures*/
-  error |= loadImage(texture[8], tw, th, "pics/barrel.png");
-  error |= loadImage(texture[9], tw, th, "pics/pillar.png");
-  error |= loadImage(texture[10], tw, th, "pics/lights.png");
-  if(error) {
-    std::cout << "Error loading sprite textures" << std::endl;
-    return 1;
-  }
+  // texture files, nothing is decoded before it comes into view
+  const char *files[NUM_TEXTURES] = {
+      "pics/bluestone.png", "pics/wood.png", "pics/wood.png", "pics/wood.png",
+      "pics/wood.png", "pics/wood.png", "pics/wood.png", "pics/wood.png",
+      /* Sprite textures*/
+      "pics/barrel.png", "pics/pillar.png", "pics/lights.png"};
+  for (int i = 0; i < NUM_TEXTURES; i++)
+    residency.addSlot(files[i]);
 #endif
+  const maze::TextureView *texture = residency.table(); // texels of each slot, the placeholder until loaded
+  for (int i = 0; i < NUM_TEXTURES; i++)
+    shadeTables.build(i, texture[i]);
+  if (!streaming)
+    minimap.build(world, texture, 8, texWidth * texHeight); /* Wall textures only */
 
   // Main loop
   while (!done())
   {
+    overlay.beginFrame();
+    minimap.beginFrame(w);
+
+    /* Make the map changes queued last frame, then update what is derived from those cells only */
+    const std::vector<maze::MapChange> &changed = streaming ? edits.apply(streamed) : edits.apply(world);
+    for (size_t i = 0; i < changed.size() && !streaming; i++)
+    {
+      lightmap.cellChanged(changed[i].x, changed[i].y);
+      visibleSets.cellChanged(changed[i].x, changed[i].y);
+    }
+    if (!streaming)
+      visibleSets.update(int(posX), int(posY), VISIBILITY_BAKES);
+    overlay.counters.cellsChanged = int(changed.size());
+
+    /* Publish the textures that finished loading, then queue what is needed */
+    const std::vector<int> &loaded = residency.update();
+    for (size_t i = 0; i < loaded.size(); i++)
+    {
+      minimap.setTexture(loaded[i], texture[loaded[i]], texWidth * texHeight);
+      shadeTables.build(loaded[i], texture[loaded[i]]);
+    }
+    residency.request(3); /* floor */
+    residency.request(6); /* ceiling */
+    if (streaming)
+    {
+      /* Read the chunks the rays of this frame may reach, and those just ahead */
+      streamed.prefetch(posX, posY, dirX, dirY, DRAW_DISTANCE + PREFETCH_CELLS);
+      overlay.counters.chunkLoads = streamed.takeLoads();
+      overlay.counters.chunksResident = streamed.residentCount();
+    }
+    else
+      residency.prefetchAhead(world, posX, posY, dirX, dirY, PREFETCH_CELLS);
+    overlay.counters.textureBytes = long(residency.residentBytes());
+    overlay.counters.texturesLoading = residency.pendingCount();
+    overlay.counters.texturesPaletted = residency.palettedCount();
+    /* Bake the light the camera came near, and what the lights added or moved since the last frame reach */
+    overlay.counters.lightCellsBaked = lightmap.update(posX, posY);
+    overlay.counters.lights = lightmap.lightCount();
 
     /**
      * Floor Casting
      */
-    for (int y = SCREEN_HEIGHT / 2 + 1; y < SCREEN_HEIGHT; y++)
+    overlay.beginStage(maze::STAGE_FLOOR);
+    for (int y = SCREEN_HEIGHT / 2; y < SCREEN_HEIGHT; y++)
     {
       // Current y position compared to the center of the screen (the horizon)
       int p = y - SCREEN_HEIGHT / 2;
@@ -183,9 +324,17 @@ int main(int ac, char **av, char **env)
       // Vertical position of the camera.
       double posZ = 0.5 * SCREEN_HEIGHT;
 
-      // Horizontal distance from the camera to the floor for the current row.
+      // Horizontal distance from the camera to the floor for the current row, infinite at the horizon.
       double rowDistance = posZ / p;
 
+      // rows beyond the draw distance are fog, floor and ceiling alike
+      if (rowDistance > DRAW_DISTANCE)
+      {
+        std::fill(buffer[y], buffer[y] + SCREEN_WIDTH, fog);
+        std::fill(buffer[SCREEN_HEIGHT - y], buffer[SCREEN_HEIGHT - y] + SCREEN_WIDTH, fog);
+        continue;
+      }
+
       // calculate the real world step vector we have to add for each x (parallel to camera plane)
       // adding step by step avoids multiplications with a weight in the inner loop
       double floorStepX = rowDistance * (dirY) / SCREEN_WIDTH;
@@ -195,12 +344,31 @@ int main(int ac, char **av, char **env)
       double floorX = posX + rowDistance * dirX;
       double floorY = posY + rowDistance * dirY;
 
+      // the whole row is at the same distance, the baked light changes with the cell
+      int floorTexture = 3;
+      int ceilingTexture = 6;
+      int attenuation = shading.attenuation(rowDistance);
+      maze::ShadedTexture<Format> floorTex, ceilingTex;
+      int litX = 0, litY = 0;
+      bool lit = false;
+
       for (int x = 0; x < SCREEN_WIDTH; x++)
       {
         // the cell coord is simply got from the integer parts of floorX and floorY
         int cellX = int(floorX);
         int cellY = int(floorY);
 
+        // new cell, new light row
+        if (!lit || cellX != litX || cellY != litY)
+        {
+          int row = shading.row(attenuation, lightmap.cell(cellX, cellY));
+          floorTex = shadeTables.get(floorTexture, texture[floorTexture], row);
+          ceilingTex = shadeTables.get(ceilingTexture, texture[ceilingTexture], row);
+          litX = cellX;
+          litY = cellY;
+          lit = true;
+        }
+
         // get the texture coordinate from the fractional part
         int tx = int(texWidth * (floorX - cellX)) & (texWidth - 1);
         int ty = int(texHeight * (floorY - cellY)) & (texHeight - 1);
@@ -208,22 +376,20 @@ int main(int ac, char **av, char **env)
         floorX += floorStepX;
         floorY += floorStepY;
 
-        // choose texture and draw the pixel
-        int floorTexture = 3;
-        int ceilingTexture = 6;
-        Uint32 floorColor = texture[floorTexture][texWidth * ty + tx];
-        Uint32 ceilingColor = texture[ceilingTexture][texWidth * ty + tx];
-
         // floor
-        buffer[y][x] = floorColor;
+        buffer[y][x] = floorTex[texWidth * ty + tx];
         //ceiling (symmetrical!)
-        buffer[SCREEN_HEIGHT - y][x] = ceilingColor;
+        buffer[SCREEN_HEIGHT - y][x] = ceilingTex[texWidth * ty + tx];
       }
     }
 
+    overlay.endStage(maze::STAGE_FLOOR);
+
     /**
      * Wall Casting
     */
+    overlay.beginStage(maze::STAGE_WALLS);
+    overlay.counters.rays = w;
     for (int x = 0; x < w; x++)
     {
       // Calculate ray position and direction
@@ -231,67 +397,21 @@ int main(int ac, char **av, char **env)
       double rayDirX = dirX + planeX * cameraX;
       double rayDirY = dirY + planeY * cameraX;
 
-      // Which box of the map we're in
-      int mapX = int(posX);
-      int mapY = int(posY);
-
-      // Length of ray from current position to next x or y-side
-      double sideDistX;
-      double sideDistY;
-
-      // Length of ray from one x or y-side to next x or y-side
-      double deltaDistX = (rayDirX == 0) ? 1e30 : std::abs(1 / rayDirX);
-      double deltaDistY = (rayDirY == 0) ? 1e30 : std::abs(1 / rayDirY);
+      // Perform DDA, up to the draw distance and the edges of the map, skipping empty blocks of the map at once
+      maze::RayHit ray = streaming ? streamed.cast(posX, posY, rayDirX, rayDirY, DRAW_DISTANCE)
+                                   : world.grid().cast(posX, posY, rayDirX, rayDirY, DRAW_DISTANCE);
+      overlay.counters.raySteps += ray.steps;
+      int mapX = ray.mapX, mapY = ray.mapY; // the wall hit
+      int stepX = ray.stepX, stepY = ray.stepY;
+      int side = ray.side; // was a NS or a EW wall hit?
       double perpWallDist;
 
-      // What direction to step in x or y-direction (either +1 or -1)
-      int stepX;
-      int stepY;
-
-      int hit = 0; // was there a wall hit?
-      int side;    // was a NS or a EW wall hit?
-
-      // Calculate step and initial sideDist
-      if (rayDirX < 0)
-      {
-        stepX = -1;
-        sideDistX = (posX - mapX) * deltaDistX;
-      }
-      else
-      {
-        stepX = 1;
-        sideDistX = (mapX + 1.0 - posX) * deltaDistX;
-      }
-      if (rayDirY < 0)
-      {
-        stepY = -1;
-        sideDistY = (posY - mapY) * deltaDistY;
-      }
-      else
-      {
-        stepY = 1;
-        sideDistY = (mapY + 1.0 - posY) * deltaDistY;
-      }
-
-      // Perform DDA
-      while (!hit)
+      // Nothing within the draw distance: the fog the floor pass left in the middle of the column stays
+      if (!ray.hit)
       {
-        // Jump to next map square, OR in x-direction, OR in y-direction
-        if (sideDistX < sideDistY)
-        {
-          sideDistX += deltaDistX;
-          mapX += stepX;
-          side = 0;
-        }
-        else
-        {
-          sideDistY += deltaDistY;
-          mapY += stepY;
-          side = 1;
-        }
-        // Check if ray has hit a wall
-        if (worldMap[mapX][mapY] > 0)
-          hit = 1;
+        minimap.setRayEnd(x, posX + DRAW_DISTANCE * rayDirX, posY + DRAW_DISTANCE * rayDirY);
+        ZBuffer[x] = DRAW_DISTANCE;
+        continue;
       }
 
       // TODO: Fix fisheye effect 191
@@ -301,6 +421,8 @@ int main(int ac, char **av, char **env)
       else
         perpWallDist = (mapY - posY + (1 - stepY) / 2) / rayDirY;
 
+      minimap.setRayEnd(x, posX + perpWallDist * rayDirX, posY + perpWallDist * rayDirY);
+
       // Calculate height of line to draw on screen
       int lineHeight = (int)(h / perpWallDist);
 
@@ -313,7 +435,10 @@ int main(int ac, char **av, char **env)
         drawEnd = h - 1;
 
       // Texturing calculations
-      int texNum = worldMap[mapX][mapY] - 1; // 1 subtracted from it so that texture 0 can be used!
+      int texNum = (streaming ? streamed.at(mapX, mapY) : world.at(mapX, mapY)) - 1; // 1 subtracted from it so that texture 0 can be used!
+      if (texNum < 0 || texNum >= NUM_TEXTURES)
+        texNum = 0; // map files aren't checked cell by cell, a bad value shows the first texture
+      residency.request(texNum);
 
       // Calculate value of wallX
       double wallX; // where exactly the wall was hit
@@ -334,35 +459,46 @@ int main(int ac, char **av, char **env)
       double step = 1.0 * texHeight / lineHeight;
       // Starting texture coordinate
       double texPos = (drawStart - h / 2 + lineHeight / 2) * step;
+      // Light of the column from its distance and the face's baked light, y-sides darker: a colormap row for paletted textures
+      int faceLight = lightmap.face(mapX, mapY, side, side == 0 ? stepX : stepY);
+      maze::ShadedTexture<Format> wallTex = shadeTables.get(texNum, texture[texNum], shading.row(shading.attenuation(perpWallDist, side == 1), faceLight));
       for (int y = drawStart; y < drawEnd; y++)
       {
         // Cast the texture coordinate to integer, and mask with (texHeight - 1) in case of overflow
         int texY = int(texPos) & (texHeight - 1);
         texPos += step;
-        Uint32 color = texture[texNum][texHeight * texY + texX];
-        // Make color darker for y-sides: R, G and B byte each divided through two with a "shift" and an "and"
-        if (side == 1)
-          color = (color >> 1) & 8355711;
-        buffer[y][x] = color;
+        buffer[y][x] = wallTex[texHeight * texY + texX];
       }
 
       /* Set the ZBuffer for casting sprite */
       ZBuffer[x] = perpWallDist; /* perpendicular distance is used */
     }
+    overlay.endStage(maze::STAGE_WALLS);
 
     /**
      * Sprite Casting
      * Sort sprites from far to close
     */
-    for (int i = 0; i < NUM_SPRITES; i++)
+    overlay.beginStage(maze::STAGE_SPRITES);
+    int numCandidates = 0; // sprites in regions the camera's region can see
+    for (int i = 0; i < numSprites; i++)
     {
-      spriteOrder[i] = i;
-      spriteDistance[i] = ((posX - sprite[i].x) * (posX - sprite[i].x) + (posY - sprite[i].y) * (posY - sprite[i].y)); // sqrt not taken, unneeded
+      double distance = ((posX - sprite[i].x) * (posX - sprite[i].x) + (posY - sprite[i].y) * (posY - sprite[i].y)); // sqrt not taken, unneeded
+      if (distance < PREFETCH_CELLS * PREFETCH_CELLS)
+        residency.prefetch(sprite[i].texture);
+      // a sprite is a cell wide, whatever way it is seen from
+      int x0 = int(std::floor(sprite[i].x - 0.5)), y0 = int(std::floor(sprite[i].y - 0.5));
+      if (!streaming && !visibleSets.visibleArea(int(posX), int(posY), x0, y0, x0 + 1, y0 + 1))
+        continue;
+      spriteOrder[numCandidates] = i;
+      spriteDistance[numCandidates] = distance;
+      numCandidates++;
     }
-    sortSprites(spriteOrder, spriteDistance, NUM_SPRITES);
+    overlay.counters.spritesTotal = numCandidates;
+    sortSprites(spriteOrder.data(), spriteDistance.data(), numCandidates);
 
     /* After sorting the sprites, do the projection and draw them */
-    for (int i = 0; i < NUM_SPRITES; i++)
+    for (int i = 0; i < numCandidates; i++)
     {
       // translate sprite position to relative to camera
       double spriteX = sprite[spriteOrder[i]].x - posX;
@@ -377,6 +513,9 @@ int main(int ac, char **av, char **env)
 
       double transformX = invDet * (dirY * spriteX - dirX * spriteY);
       double transformY = invDet * (-planeY * spriteX + planeX * spriteY); // this is actually the depth inside the screen, that what Z is in 3D
+      // nothing behind the camera plane is drawn, and level with it the projection divides by 0
+      if (transformY <= 0)
+        continue;
 
       int spriteScreenX = int((w / 2) * (1 + transformX / transformY));
 
@@ -400,6 +539,11 @@ int main(int ac, char **av, char **env)
         drawEndX = w - 1;
 
       // loop through every vertical stripe of the sprite on screen
+      bool drawn = false;
+      int spriteTexture = sprite[spriteOrder[i]].texture;
+      // lit by its cell, lights themselves are always at full light
+      int spriteLight = spriteTexture == LIGHT_TEXTURE ? maze::Shading::UNIT : lightmap.cell(int(sprite[spriteOrder[i]].x), int(sprite[spriteOrder[i]].y));
+      maze::ShadedTexture<Format> spriteTex = shadeTables.get(spriteTexture, texture[spriteTexture], shading.row(shading.attenuation(transformY), spriteLight));
       for (int stripe = drawStartX; stripe < drawEndX; stripe++)
       {
         int texX = int(256 * (stripe - (-spriteWidth / 2 + spriteScreenX)) * texWidth / spriteWidth) / 256;
@@ -409,46 +553,100 @@ int main(int ac, char **av, char **env)
         // 3) it's on the screen (right)
         // 4) ZBuffer, with perpendicular distance
         if (transformY > 0 && stripe > 0 && stripe < w && transformY < ZBuffer[stripe])
+        {
+          if (!drawn)
+            residency.request(sprite[spriteOrder[i]].texture);
+          drawn = true;
           for (int y = drawStartY; y < drawEndY; y++) // for every pixel of the current stripe
           {
             int d = (y) * 256 - h * 128 + spriteHeight * 128; // 256 and 128 factors to avoid floats
             int texY = ((d * texHeight) / spriteHeight) / 256;
-            Uint32 color = texture[sprite[spriteOrder[i]].texture][texWidth * texY + texX]; // get current color from the texture
-            if ((color & 0x00FFFFFF) != 0)
-              buffer[y][stripe] = color;
+            int texel = texWidth * texY + texX;
+            if (spriteTex.opaque(texel)) // paint pixel if it isn't black, black is the invisible color
+              buffer[y][stripe] = spriteTex[texel];
           }
+        }
+      }
+      if (drawn)
+      {
+        overlay.counters.spritesDrawn++;
+        minimap.addSprite(sprite[spriteOrder[i]].x, sprite[spriteOrder[i]].y);
       }
     }
+    overlay.endStage(maze::STAGE_SPRITES);
+
+    /* Expand the frame to the screen, the minimap and overlay are drawn on top of it there */
+    overlay.beginStage(maze::STAGE_PRESENT);
+    Format::present(buffer[0]);
+    overlay.endStage(maze::STAGE_PRESENT);
+
+    overlay.beginStage(maze::STAGE_OVERLAY);
+    minimap.draw(screenCanvas(), posX, posY, dirX, dirY);
+    overlay.endStage(maze::STAGE_OVERLAY);
+    overlay.draw(screenCanvas());
+
+    overlay.beginStage(maze::STAGE_PRESENT);
 
-    drawBuffer(buffer[0]);
-    
     /* Timing input for FPS counter */
     oldTime = time;
     time = SDL_GetTicks();
     double frameTime = (time - oldTime) / 1000.0; // frameTime is the time this frame has taken, in seconds
-    print(1.0 / frameTime);                       // FPS counter
+    if (!overlay.isVisible())
+      print(1.0 / frameTime); // FPS counter
     redraw();
+    overlay.endStage(maze::STAGE_PRESENT);
 
     // Speed modifiers
     double moveSpeed = frameTime * 5.0; // the constant value is in squares/second
     double rotSpeed = frameTime * 3.0;  // the constant value is in radians/second
 
     readKeys();
+    // Toggle the performance overlay
+    if (keyPressed(SDLK_F1))
+      overlay.toggle();
+    // Toggle the minimap
+    if (keyPressed(SDLK_m))
+      minimap.toggle();
+    // Leave a light where you stand, the lightmap only covers maps in memory
+    if (keyPressed(SDLK_l) && !streaming)
+      lightmap.addLight(posX, posY, LIGHT_INTENSITY);
+    // Open the wall in front of you, or close one you opened
+    if (keyPressed(SDLK_e))
+    {
+      int doorX = int(posX + dirX), doorY = int(posY + dirY);
+      std::pair<int, int> door(doorX, doorY);
+      bool inside = streaming ? streamed.inside(doorX, doorY) : world.inside(doorX, doorY);
+      if (inside && (doorX != int(posX) || doorY != int(posY)))
+      {
+        Uint8 value = streaming ? streamed.at(doorX, doorY) : world.at(doorX, doorY);
+        if (value)
+        {
+          opened[door] = value;
+          edits.set(doorX, doorY, 0);
+        }
+        else if (opened.count(door))
+        {
+          edits.set(doorX, doorY, opened[door]);
+          opened.erase(door);
+        }
+      }
+    }
+
     // Move forward if no wall in front of you
     if (keyDown(SDLK_UP) || keyDown(SDLK_w)) // move using arrow up or w key
     {
-      if (worldMap[int(posX + dirX * moveSpeed)][int(posY)] == false)
+      if (streaming ? streamed.walkable(int(posX + dirX * moveSpeed), int(posY)) : world.walkable(int(posX + dirX * moveSpeed), int(posY)))
         posX += dirX * moveSpeed;
-      if (worldMap[int(posX)][int(posY + dirY * moveSpeed)] == false)
+      if (streaming ? streamed.walkable(int(posX), int(posY + dirY * moveSpeed)) : world.walkable(int(posX), int(posY + dirY * moveSpeed)))
         posY += dirY * moveSpeed;
     }
 
     // Move backwards if no wall behind you
     if (keyDown(SDLK_DOWN) || keyDown(SDLK_s)) // move using arrow down or s key
     {
-      if (worldMap[int(posX - dirX * moveSpeed)][int(posY)] == false)
+      if (streaming ? streamed.walkable(int(posX - dirX * moveSpeed), int(posY)) : world.walkable(int(posX - dirX * moveSpeed), int(posY)))
         posX -= dirX * moveSpeed;
-      if (worldMap[int(posX)][int(posY - dirY * moveSpeed)] == false)
+      if (streaming ? streamed.walkable(int(posX), int(posY - dirY * moveSpeed)) : world.walkable(int(posX), int(posY - dirY * moveSpeed)))
         posY -= dirY * moveSpeed;
     }
 
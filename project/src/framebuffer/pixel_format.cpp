@@ -0,0 +1,79 @@
+#include "pixel_format.hpp"
+
+namespace maze
+{
+  static const int CUBE = 6;                         /* Levels per channel of the color cube */
+  static const int GREYS = 256 - CUBE * CUBE * CUBE; /* Grey ramp in the indices after the cube */
+
+  Uint32 PixelIndex8::palette[256];
+  Uint8 PixelIndex8::fromRGB555[32768];
+
+  /**
+   * level - nearest level of an 8-bit channel
+   * @value: the channel
+   * @levels: number of levels spread over 0-255
+   * Return: the level
+   */
+  static int level(int value, int levels)
+  {
+    return (value * (levels - 1) + 127) / 255;
+  }
+
+  /**
+   * distance - squared distance between a color and a palette entry
+   * @r: red
+   * @g: green
+   * @b: blue
+   * @index: the entry
+   * Return: the distance
+   */
+  static int distance(int r, int g, int b, int index)
+  {
+    Uint32 c = PixelIndex8::palette[index];
+    int dr = r - int((c >> 16) & 255), dg = g - int((c >> 8) & 255), db = b - int(c & 255);
+    return dr * dr + dg * dg + db * db;
+  }
+
+  /**
+   * nearestIndex - palette index closest to a color
+   * @r: red
+   * @g: green
+   * @b: blue
+   *
+   * The nearest cube color and the nearest grey are found directly, the
+   * closer of the two wins.
+   * Return: the index
+   */
+  static Uint8 nearestIndex(int r, int g, int b)
+  {
+    int cube = (level(r, CUBE) * CUBE + level(g, CUBE)) * CUBE + level(b, CUBE);
+    int grey = CUBE * CUBE * CUBE + level((r + g + b) / 3, GREYS);
+    return Uint8(distance(r, g, b, grey) < distance(r, g, b, cube) ? grey : cube);
+  }
+
+  /**
+   * init - build the palette and the packing table
+   *
+   * The palette is a 6x6x6 color cube followed by a ramp of 40 greys, which
+   * keeps dark and desaturated colors, and shaded greys, from turning into
+   * tinted cube colors.
+   * Return: void
+   */
+  void PixelIndex8::init()
+  {
+    for (int r = 0; r < CUBE; r++)
+      for (int g = 0; g < CUBE; g++)
+        for (int b = 0; b < CUBE; b++)
+          palette[(r * CUBE + g) * CUBE + b] = 0xFF000000 | Uint32(r * 255 / (CUBE - 1)) << 16 |
+                                               Uint32(g * 255 / (CUBE - 1)) << 8 | Uint32(b * 255 / (CUBE - 1));
+    for (int i = 0; i < GREYS; i++)
+      palette[CUBE * CUBE * CUBE + i] = 0xFF000000 | Uint32(i * 255 / (GREYS - 1)) * 0x010101;
+
+    /* Channels of 15-bit colors are widened the way drawBuffer widens RGB565 */
+    for (int c = 0; c < 32768; c++)
+    {
+      int r = c >> 10, g = (c >> 5) & 31, b = c & 31;
+      fromRGB555[c] = nearestIndex(r << 3 | r >> 2, g << 3 | g >> 2, b << 3 | b >> 2);
+    }
+  }
+}
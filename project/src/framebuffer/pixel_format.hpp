@@ -0,0 +1,67 @@
+/**
+ * @file pixel_format.hpp
+ * @brief Pixel formats the renderer can write its frame in.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_PIXEL_FORMAT_H__
+#define __THE_MAZE_PIXEL_FORMAT_H__
+
+#include "../../../lib/quickcg.h"
+
+namespace maze
+{
+  /*
+   * Every format has the same interface, so the render passes are written
+   * once and the format is picked when the game is compiled:
+   *   Type     - one pixel of the frame buffer
+   *   init()   - build the tables the format needs, once before rendering
+   *   pack(c)  - a 32-bit ARGB color as a pixel
+   *   present(buffer) - expand the frame to the 32-bit screen
+   */
+
+  /**
+   * PixelARGB32 - 4 bytes per pixel, the texture format, nothing to convert.
+   */
+  struct PixelARGB32
+  {
+    typedef Uint32 Type;
+    static void init() {}
+    static Type pack(Uint32 color) { return color; }
+    static void present(Type *buffer) { QuickCG::drawBuffer(buffer); }
+  };
+
+  /**
+   * PixelRGB565 - 2 bytes per pixel, half the frame memory traffic.
+   */
+  struct PixelRGB565
+  {
+    typedef Uint16 Type;
+    static void init() {}
+    static Type pack(Uint32 color) { return QuickCG::toRGB565(color); }
+    static void present(const Type *buffer) { QuickCG::drawBuffer(buffer); }
+  };
+
+  /**
+   * PixelIndex8 - 1 byte per pixel, indices into a fixed palette.
+   *
+   * Colors are packed through a table indexed by their 15-bit RGB. Shading
+   * is done before packing, or by colormaps that map to indices directly.
+   */
+  struct PixelIndex8
+  {
+    typedef Uint8 Type;
+    static void init();
+    static Type pack(Uint32 color)
+    {
+      return fromRGB555[((color >> 9) & 0x7C00) | ((color >> 6) & 0x03E0) | ((color >> 3) & 0x001F)];
+    }
+    static void present(const Type *buffer) { QuickCG::drawBuffer(buffer, palette); }
+
+    static Uint32 palette[256];     /* ARGB color of every index */
+    static Uint8 fromRGB555[32768]; /* Nearest index of every 15-bit color */
+  };
+}
+
+#endif // __THE_MAZE_PIXEL_FORMAT_H__
@@ -0,0 +1,344 @@
+#include "lightmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace maze
+{
+  /**
+   * Lightmap - set up an unlit map, nothing is baked before the first update()
+   * @map: the map
+   * @ambient: light everywhere without any light, 1 is full light
+   * @radius: distance where lights stop reaching, in cells
+   * @range: distance from the camera the light is kept baked to, in cells
+   */
+  Lightmap::Lightmap(const WorldMap &map, double ambient, double radius, double range)
+      : map(map), mapWidth(map.width()), mapHeight(map.height()), tilesWide((mapWidth + TILE - 1) >> TILE_SHIFT),
+        tilesHigh((mapHeight + TILE - 1) >> TILE_SHIFT), ambient(ambient), radius(radius), range(range),
+        tileAt(size_t(tilesWide) * tilesHigh, -1)
+  {
+    ambientLevel = quantize(ambient);
+  }
+
+  /**
+   * addLight - add a point light
+   * @x: position x
+   * @y: position y
+   * @intensity: light added right at the light, 1 is full light
+   * Return: the light's id
+   */
+  int Lightmap::addLight(double x, double y, double intensity)
+  {
+    Light light = {x, y, intensity};
+    lights.push_back(light);
+    dirtyAround(light);
+    return int(lights.size()) - 1;
+  }
+
+  /**
+   * moveLight - move a light, the cells it left and reaches get rebaked
+   * @light: its id
+   * @x: new position x
+   * @y: new position y
+   * Return: void
+   */
+  void Lightmap::moveLight(int light, double x, double y)
+  {
+    dirtyAround(lights[light]);
+    lights[light].x = x;
+    lights[light].y = y;
+    dirtyAround(lights[light]);
+  }
+
+  /**
+   * setIntensity - change how bright a light is, 0 switches it off
+   * @light: its id
+   * @intensity: the new intensity
+   * Return: void
+   */
+  void Lightmap::setIntensity(int light, double intensity)
+  {
+    lights[light].intensity = intensity;
+    dirtyAround(lights[light]);
+  }
+
+  /**
+   * markDirty - queue the cells of a rectangle for rebaking
+   * @x0: first cell x
+   * @y0: first cell y
+   * @x1: last cell x
+   * @y1: last cell y
+   *
+   * Also for changes of the map: a changed cell affects what every light
+   * within the radius sees, so the rectangle should reach twice the radius
+   * around it. Only kept tiles have cells to mark, the others are baked
+   * whole when the camera comes near.
+   * Return: void
+   */
+  void Lightmap::markDirty(int x0, int y0, int x1, int y1)
+  {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, mapWidth - 1);
+    y1 = std::min(y1, mapHeight - 1);
+    for (int tx = x0 >> TILE_SHIFT; x0 <= x1 && tx <= x1 >> TILE_SHIFT; tx++)
+      for (int ty = y0 >> TILE_SHIFT; y0 <= y1 && ty <= y1 >> TILE_SHIFT; ty++)
+      {
+        int t = tileAt[size_t(tx) * tilesHigh + ty];
+        if (t < 0)
+          continue;
+        Tile &tile = tiles[t];
+        for (int x = std::max(x0, tx << TILE_SHIFT); x <= std::min(x1, (tx << TILE_SHIFT) + TILE - 1); x++)
+          for (int y = std::max(y0, ty << TILE_SHIFT); y <= std::min(y1, (ty << TILE_SHIFT) + TILE - 1); y++)
+            if (!tile.dirty[offset(x, y)])
+            {
+              tile.dirty[offset(x, y)] = true;
+              tile.dirtyCells.push_back(offset(x, y));
+            }
+      }
+  }
+
+  /**
+   * cellChanged - mark what a change of a map cell can relight
+   * @x: cell x
+   * @y: cell y
+   *
+   * The lights within the radius of the cell now see more or less of the
+   * cells within their own radius.
+   * Return: void
+   */
+  void Lightmap::cellChanged(int x, int y)
+  {
+    int r = 2 * int(std::ceil(radius));
+    markDirty(x - r, y - r, x + r, y + r);
+  }
+
+  /**
+   * dirtyAround - mark the cells a light reaches
+   * @light: the light
+   * Return: void
+   */
+  void Lightmap::dirtyAround(const Light &light)
+  {
+    int r = int(std::ceil(radius));
+    markDirty(int(light.x) - r, int(light.y) - r, int(light.x) + r, int(light.y) + r);
+  }
+
+  /**
+   * update - keep the tiles around the camera and rebake their dirty cells
+   * @x: camera x
+   * @y: camera y
+   *
+   * Tiles a tile further than the range are dropped, so walking along a
+   * tile border doesn't bake the same ones over and over. Only the lights
+   * that reach the rectangle around the dirty cells of a tile are looked
+   * at, so a small change costs the same however many lights the map has.
+   * Return: the number of cells rebaked
+   */
+  int Lightmap::update(double x, double y)
+  {
+    int tx0 = int(std::floor(x - range)) >> TILE_SHIFT, tx1 = int(std::floor(x + range)) >> TILE_SHIFT;
+    int ty0 = int(std::floor(y - range)) >> TILE_SHIFT, ty1 = int(std::floor(y + range)) >> TILE_SHIFT;
+    for (int t = int(tiles.size()) - 1; t >= 0; t--)
+      if (tiles[t].tx < tx0 - 1 || tiles[t].tx > tx1 + 1 || tiles[t].ty < ty0 - 1 || tiles[t].ty > ty1 + 1)
+        unload(t);
+    for (int tx = std::max(tx0, 0); tx <= std::min(tx1, tilesWide - 1); tx++)
+      for (int ty = std::max(ty0, 0); ty <= std::min(ty1, tilesHigh - 1); ty++)
+        if (tileAt[size_t(tx) * tilesHigh + ty] < 0)
+          load(tx, ty);
+
+    int count = 0;
+    for (size_t t = 0; t < tiles.size(); t++)
+      count += bake(tiles[t]);
+    return count;
+  }
+
+  /**
+   * load - keep a tile, all of it waiting for its bake
+   * @tx: tile x
+   * @ty: tile y
+   * Return: void
+   */
+  void Lightmap::load(int tx, int ty)
+  {
+    tileAt[size_t(tx) * tilesHigh + ty] = int(tiles.size());
+    tiles.push_back(Tile());
+    Tile &tile = tiles.back();
+    tile.tx = tx;
+    tile.ty = ty;
+    tile.levels.assign(TILE * TILE, Uint8(ambientLevel));
+    tile.faces.assign(4 * TILE * TILE, Uint8(ambientLevel));
+    tile.dirty.assign(TILE * TILE, false);
+    markDirty(tx << TILE_SHIFT, ty << TILE_SHIFT, (tx << TILE_SHIFT) + TILE - 1, (ty << TILE_SHIFT) + TILE - 1);
+  }
+
+  /**
+   * unload - drop a kept tile, the last one takes its place
+   * @t: its index in tiles
+   * Return: void
+   */
+  void Lightmap::unload(int t)
+  {
+    tileAt[size_t(tiles[t].tx) * tilesHigh + tiles[t].ty] = -1;
+    if (t != int(tiles.size()) - 1)
+    {
+      std::swap(tiles[t], tiles.back());
+      tileAt[size_t(tiles[t].tx) * tilesHigh + tiles[t].ty] = t;
+    }
+    tiles.pop_back();
+  }
+
+  /**
+   * bake - rebake the dirty cells of a tile
+   * @tile: the tile
+   * Return: the number of cells rebaked
+   */
+  int Lightmap::bake(Tile &tile)
+  {
+    int count = int(tile.dirtyCells.size());
+    if (count == 0)
+      return 0;
+    int x0 = TILE, y0 = TILE, x1 = -1, y1 = -1;
+    for (int i = 0; i < count; i++)
+    {
+      int x = tile.dirtyCells[i] >> TILE_SHIFT, y = tile.dirtyCells[i] & (TILE - 1);
+      x0 = x < x0 ? x : x0;
+      y0 = y < y0 ? y : y0;
+      x1 = x > x1 ? x : x1;
+      y1 = y > y1 ? y : y1;
+    }
+    int left = tile.tx << TILE_SHIFT, top = tile.ty << TILE_SHIFT;
+    nearby.clear();
+    for (size_t l = 0; l < lights.size(); l++)
+      if (lights[l].x > left + x0 - radius && lights[l].x < left + x1 + 1 + radius &&
+          lights[l].y > top + y0 - radius && lights[l].y < top + y1 + 1 + radius)
+        nearby.push_back(int(l));
+    for (int i = 0; i < count; i++)
+    {
+      int cell = tile.dirtyCells[i];
+      rebake(tile, left + (cell >> TILE_SHIFT), top + (cell & (TILE - 1)));
+      tile.dirty[cell] = false;
+    }
+    tile.dirtyCells.clear();
+    return count;
+  }
+
+  /**
+   * rebake - bake one cell: its center if empty, its open faces if a wall
+   * @tile: the kept tile of the cell
+   * @x: cell x
+   * @y: cell y
+   * Return: void
+   */
+  void Lightmap::rebake(Tile &tile, int x, int y)
+  {
+    static const int normals[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    int i = offset(x, y);
+    if (!wall(x, y))
+    {
+      tile.levels[i] = quantize(lightAt(x + 0.5, y + 0.5, 0, 0));
+      /* No faces, but the walls of a streamed world may fall on the cell */
+      for (int f = 0; f < 4; f++)
+        tile.faces[4 * i + f] = Uint8(ambientLevel);
+      return;
+    }
+    tile.levels[i] = Uint8(ambientLevel);
+    for (int f = 0; f < 4; f++)
+    {
+      int nx = normals[f][0], ny = normals[f][1];
+      /* Faces against another wall are never seen */
+      tile.faces[4 * i + f] = wall(x + nx, y + ny) ? Uint8(ambientLevel) : quantize(lightAt(x + 0.5 + 0.5 * nx, y + 0.5 + 0.5 * ny, nx, ny));
+    }
+  }
+
+  /**
+   * lightAt - light arriving at a point, from the lights update() found nearby
+   * @x: point x
+   * @y: point y
+   * @nx: normal x of the face the point is on, 0 for a floor point
+   * @ny: normal y, 0 for a floor point
+   * Return: the light, 1 is full light
+   */
+  double Lightmap::lightAt(double x, double y, double nx, double ny) const
+  {
+    double total = ambient;
+    /* Points on a face are seen from just in front of it, in the empty cell */
+    double px = x + nx * 1e-3, py = y + ny * 1e-3;
+    for (size_t n = 0; n < nearby.size(); n++)
+    {
+      const Light &light = lights[nearby[n]];
+      double dx = light.x - x, dy = light.y - y;
+      double distance = std::sqrt(dx * dx + dy * dy);
+      if (light.intensity <= 0 || distance >= radius)
+        continue;
+      double facing = 1.0;
+      if (nx || ny)
+      {
+        facing = distance > 0 ? (dx * nx + dy * ny) / distance : 0;
+        if (facing <= 0)
+          continue;
+      }
+      if (!visible(light.x, light.y, px, py))
+        continue;
+      double fade = 1.0 - distance / radius;
+      total += light.intensity * fade * fade * facing;
+    }
+    return total;
+  }
+
+  /**
+   * visible - whether a segment crosses no wall cell
+   * @x0: start x, the light
+   * @y0: start y
+   * @x1: end x
+   * @y1: end y
+   *
+   * The DDA of the wall pass, stopped at the cell of the end point. The cell
+   * of the start point doesn't count, so a light inside a wall still lights
+   * around it.
+   * Return: true if nothing is in the way
+   */
+  bool Lightmap::visible(double x0, double y0, double x1, double y1) const
+  {
+    int mapX = int(x0), mapY = int(y0);
+    int endX = int(x1), endY = int(y1);
+    double rayDirX = x1 - x0, rayDirY = y1 - y0;
+    double deltaDistX = (rayDirX == 0) ? 1e30 : std::abs(1 / rayDirX);
+    double deltaDistY = (rayDirY == 0) ? 1e30 : std::abs(1 / rayDirY);
+    int stepX = rayDirX < 0 ? -1 : 1, stepY = rayDirY < 0 ? -1 : 1;
+    double sideDistX = (rayDirX < 0 ? x0 - mapX : mapX + 1.0 - x0) * deltaDistX;
+    double sideDistY = (rayDirY < 0 ? y0 - mapY : mapY + 1.0 - y0) * deltaDistY;
+
+    /* The segment is t in [0, 1], it crosses at most this many cell borders */
+    int steps = std::abs(endX - mapX) + std::abs(endY - mapY);
+    for (int i = 0; i < steps; i++)
+    {
+      if (sideDistX < sideDistY)
+      {
+        sideDistX += deltaDistX;
+        mapX += stepX;
+      }
+      else
+      {
+        sideDistY += deltaDistY;
+        mapY += stepY;
+      }
+      if (mapX == endX && mapY == endY)
+        return true;
+      if (wall(mapX, mapY))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * quantize - the level of a light
+   * @light: the light, 1 is full light
+   * Return: the level, overbright light is capped at the last one
+   */
+  Uint8 Lightmap::quantize(double light) const
+  {
+    int level = int(light * Shading::UNIT + 0.5);
+    return Uint8(level < 0 ? 0 : level >= Shading::LIGHTS ? Shading::LIGHTS - 1 : level);
+  }
+}
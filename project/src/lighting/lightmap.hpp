@@ -0,0 +1,133 @@
+/**
+ * @file lightmap.hpp
+ * @brief Light baked per cell and per wall face from point lights.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_LIGHTMAP_H__
+#define __THE_MAZE_LIGHTMAP_H__
+
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+#include "../shading/shading.hpp"
+#include "../world/world_map.hpp"
+
+namespace maze
+{
+  /**
+   * Lightmap - baked light levels around the camera, in tiles of the map.
+   *
+   * Every empty cell has the light at its center, used for its floor, its
+   * ceiling and the sprites in it. Every wall cell has one light per face.
+   * Lights reach what their DDA ray gets to without crossing a wall, up to
+   * their radius, so a light only ever affects the cells within its radius.
+   *
+   * Levels are Shading light levels: the renderer reads one byte per wall
+   * column, floor cell or sprite, whatever the number of lights. Only the
+   * tiles within the range of the camera are kept: update() bakes the ones
+   * it comes near and drops the ones it left, so loading costs nothing and
+   * memory follows the range, not the map, but for an int per tile. Adding
+   * or moving a light marks the cells around its old and new positions, so
+   * does a change of the map, and update() rebakes only those. Cells off
+   * the kept tiles read as ambient.
+   */
+  class Lightmap
+  {
+  public:
+    static const int TILE_SHIFT = 5;
+    static const int TILE = 1 << TILE_SHIFT; /* Cells along each side of a tile */
+
+    Lightmap(const WorldMap &map, double ambient, double radius, double range);
+
+    int addLight(double x, double y, double intensity);
+    void moveLight(int light, double x, double y);
+    void setIntensity(int light, double intensity);
+    void markDirty(int x0, int y0, int x1, int y1);
+    void cellChanged(int x, int y);
+    int update(double x, double y);
+
+    /**
+     * cell - the light level of an empty cell
+     * @x: cell x
+     * @y: cell y
+     * Return: the level, the ambient level outside the map
+     */
+    int cell(int x, int y) const
+    {
+      const Tile *tile = find(x, y);
+      return tile ? tile->levels[offset(x, y)] : ambientLevel;
+    }
+
+    /**
+     * face - the light level of the wall face a ray hits
+     * @x: wall cell x
+     * @y: wall cell y
+     * @side: 0 for an x-side, 1 for a y-side, as in the DDA
+     * @step: the ray's step along that axis
+     * Return: the level, the ambient level outside the map or off its walls
+     */
+    int face(int x, int y, int side, int step) const
+    {
+      const Tile *tile = find(x, y);
+      return tile ? tile->faces[4 * offset(x, y) + 2 * side + (step > 0 ? 0 : 1)] : ambientLevel;
+    }
+
+    int lightCount() const { return int(lights.size()); }
+    int tileCount() const { return int(tiles.size()); }
+
+  private:
+    struct Light
+    {
+      double x, y, intensity;
+    };
+
+    /* A tile of kept light, cell (x, y) of the map at offset(x, y) */
+    struct Tile
+    {
+      int tx, ty;
+      std::vector<Uint8> levels;  /* Level of every cell */
+      std::vector<Uint8> faces;   /* 4 levels per cell: x-, x+, y- and y+ facing */
+      std::vector<bool> dirty;
+      std::vector<int> dirtyCells; /* Offsets */
+    };
+
+    /**
+     * find - the kept tile of a cell
+     * @x: cell x
+     * @y: cell y
+     * Return: the tile, NULL outside the map or off the kept tiles
+     */
+    const Tile *find(int x, int y) const
+    {
+      if (x < 0 || y < 0 || x >= mapWidth || y >= mapHeight)
+        return 0;
+      int t = tileAt[size_t(x >> TILE_SHIFT) * tilesHigh + (y >> TILE_SHIFT)];
+      return t < 0 ? 0 : &tiles[t];
+    }
+    static int offset(int x, int y) { return (x & (TILE - 1)) << TILE_SHIFT | (y & (TILE - 1)); }
+
+    void load(int tx, int ty);
+    void unload(int t);
+    int bake(Tile &tile);
+    void dirtyAround(const Light &light);
+    void rebake(Tile &tile, int x, int y);
+    double lightAt(double x, double y, double nx, double ny) const;
+    bool visible(double x0, double y0, double x1, double y1) const;
+    Uint8 quantize(double light) const;
+    bool wall(int x, int y) const { return !map.inside(x, y) || map.wall(x, y); }
+
+    const WorldMap &map;
+    int mapWidth, mapHeight;
+    int tilesWide, tilesHigh;
+    double ambient, radius, range;
+    int ambientLevel;
+    std::vector<Light> lights;
+    std::vector<int> tileAt;   /* Index in tiles of every tile of the map, -1 if not kept */
+    std::vector<Tile> tiles;   /* The kept ones */
+    std::vector<int> nearby;   /* Lights that reach the cells being rebaked */
+  };
+}
+
+#endif // __THE_MAZE_LIGHTMAP_H__
@@ -0,0 +1,188 @@
+#include "minimap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace maze
+{
+  static const Uint32 OUTSIDE_COLOR = 0x000000; /* Beyond the map edge */
+  static const Uint32 FLOOR_COLOR = 0x303030;   /* Empty cells */
+  static const Uint32 WALL_COLOR = 0xC0C0C0;    /* Walls without a texture */
+  static const Uint32 CONE_COLOR = 0xE0D040;
+  static const Uint32 PLAYER_COLOR = 0xFF4040;
+  static const Uint32 SPRITE_COLOR = 0x40C0FF;
+  static const int CONE_RAYS = 48; /* Rays of the view cone drawn on the minimap */
+
+  /**
+   * floorDiv - integer division rounding towards minus infinity
+   * @a: dividend
+   * @b: divisor, positive
+   * Return: the quotient
+   */
+  static int floorDiv(int a, int b)
+  {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+  }
+
+  /**
+   * averageColor - average color of a texture
+   * @tex: the texels, neither pointer set for a missing texture
+   * @texels: number of texels
+   * Return: the color, WALL_COLOR for a missing texture
+   */
+  static Uint32 averageColor(const TextureView &tex, size_t texels)
+  {
+    if ((!tex.pixels && !tex.indices) || texels == 0)
+      return WALL_COLOR;
+    unsigned long r = 0, g = 0, b = 0;
+    for (size_t i = 0; i < texels; i++)
+    {
+      Uint32 c = tex.texel(int(i));
+      r += (c >> 16) & 255;
+      g += (c >> 8) & 255;
+      b += c & 255;
+    }
+    return Uint32((r / texels) << 16 | (g / texels) << 8 | (b / texels));
+  }
+
+  Minimap::Minimap(int size, int cellSize)
+      : visible(false), size(size), cellSize(cellSize), map(0), mapWidth(0), mapHeight(0), numTextures(0)
+  {
+    colors[0] = FLOOR_COLOR;
+    std::fill(colors + 1, colors + 256, WALL_COLOR);
+  }
+
+  /**
+   * build - set the map to show and the colors of its textures
+   * @map: the map
+   * @textures: wall textures, a cell with value v uses textures[v - 1]
+   * @numTextures: number of textures
+   * @texels: pixels in each texture
+   * Return: void
+   */
+  void Minimap::build(const WorldMap &map, const TextureView *textures, int numTextures, size_t texels)
+  {
+    this->map = &map;
+    mapWidth = map.width();
+    mapHeight = map.height();
+
+    this->numTextures = std::min(numTextures, 255);
+    std::fill(colors + 1, colors + 256, WALL_COLOR);
+    for (int t = 0; t < this->numTextures; t++)
+      colors[t + 1] = averageColor(textures[t], texels);
+  }
+
+  /**
+   * setTexture - recolor the cells of a texture that was replaced, e.g. loaded late
+   * @t: texture index, cells with value t + 1 use it
+   * @tex: the new texels
+   * @texels: texels in the texture
+   * Return: void
+   */
+  void Minimap::setTexture(int t, const TextureView &tex, size_t texels)
+  {
+    if (t < 0 || t >= numTextures)
+      return;
+    colors[t + 1] = averageColor(tex, texels);
+  }
+
+  /**
+   * beginFrame - forget the rays and sprites of the previous frame
+   * @columns: number of screen columns the wall pass casts
+   * Return: void
+   */
+  void Minimap::beginFrame(int columns)
+  {
+    if (int(rayX.size()) != columns)
+    {
+      rayX.assign(columns, 0.0f);
+      rayY.assign(columns, 0.0f);
+    }
+    spriteX.clear();
+    spriteY.clear();
+  }
+
+  /**
+   * addSprite - mark a sprite that was drawn this frame
+   * @x: map x
+   * @y: map y
+   * Return: void
+   */
+  void Minimap::addSprite(double x, double y)
+  {
+    spriteX.push_back(float(x));
+    spriteY.push_back(float(y));
+  }
+
+  /**
+   * draw - composite the minimap into the top right corner of a canvas
+   * @target: the canvas, the screen or a 32-bit render buffer
+   * @posX: player x
+   * @posY: player y
+   * @dirX: view direction x
+   * @dirY: view direction y
+   * Return: void
+   */
+  void Minimap::draw(const QuickCG::Canvas &target, double posX, double posY, double dirX, double dirY)
+  {
+    if (!visible || !map)
+      return;
+
+    int left = target.width - size - 8, top = 8;
+    if (left < 0 || top + size > target.height)
+      return;
+    QuickCG::Canvas canvas(target.pixels + top * target.pitch + left, size, size, target.pitch);
+
+    /* The player sits in the middle; origins are in minimap pixels from the map corner */
+    int half = size / 2;
+    int originX = int(std::floor(posX * cellSize)) - half;
+    int originY = int(std::floor(posY * cellSize)) - half;
+    int previous = 0; /* Cell row of the pixel row above, none for the first */
+    for (int py = 0; py < size; py++)
+    {
+      Uint32 *row = canvas.pixels + py * canvas.pitch;
+      int mx = floorDiv(originX + py, cellSize);
+      if (py > 0 && mx == previous)
+      {
+        /* Same cells as the row above */
+        std::copy(row - canvas.pitch, row - canvas.pitch + size, row);
+        continue;
+      }
+      previous = mx;
+      if (mx < 0 || mx >= mapWidth)
+      {
+        QuickCG::fillSpan(row, size, OUTSIDE_COLOR);
+        continue;
+      }
+      for (int px = 0, mp = originY; px < size;)
+      {
+        int my = floorDiv(mp, cellSize);
+        int run = std::min(size - px, (my + 1) * cellSize - mp);
+        QuickCG::fillSpan(row + px, run, (my < 0 || my >= mapHeight) ? OUTSIDE_COLOR : colors[map->at(mx, my)]);
+        px += run;
+        mp += run;
+      }
+    }
+
+    /* View cone from the rays the wall pass cast, the canvas clips it to the minimap */
+    list.clear();
+    int columns = int(rayX.size());
+    for (int i = 0; i < CONE_RAYS && columns > 0; i++)
+    {
+      int column = (columns - 1) * i / (CONE_RAYS - 1);
+      int ex = half + int((rayY[column] - posY) * cellSize);
+      int ey = half + int((rayX[column] - posX) * cellSize);
+      list.drawLine(half, half, ex, ey, CONE_COLOR);
+    }
+    for (size_t i = 0; i < spriteX.size(); i++)
+      list.drawDisk(half + int((spriteY[i] - posY) * cellSize), half + int((spriteX[i] - posX) * cellSize), 2, SPRITE_COLOR);
+    list.drawDisk(half, half, 3, PLAYER_COLOR);
+    list.drawLine(half, half, half + int(dirY * 8), half + int(dirX * 8), PLAYER_COLOR);
+
+    list.horLine(0, 0, size - 1, 0x808080);
+    list.horLine(size - 1, 0, size - 1, 0x808080);
+    list.verLine(0, 0, size - 1, 0x808080);
+    list.verLine(size - 1, 0, size - 1, 0x808080);
+    list.draw(canvas);
+  }
+}
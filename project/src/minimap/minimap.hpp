@@ -0,0 +1,70 @@
+/**
+ * @file minimap.hpp
+ * @brief Top-down minimap composited into the render buffer.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_MINIMAP_H__
+#define __THE_MAZE_MINIMAP_H__
+
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+#include "../textures/texture_palette.hpp"
+#include "../world/world_map.hpp"
+
+namespace maze
+{
+  /**
+   * Minimap - top-down view of the map, looked up as it is drawn.
+   *
+   * A frame reads the cells of the minimap window straight from the map and
+   * turns each value into a color through a table, a run of pixels per
+   * cell. It costs the pixels of the window however big the map is, nothing
+   * is kept per cell and changes of the map show at once. A texture that
+   * changes only changes its entry of the table. Map x runs down the minimap
+   * and map y to the right, the same way the worldMap literal reads.
+   */
+  class Minimap
+  {
+  public:
+    Minimap(int size = 192, int cellSize = 6);
+
+    void build(const WorldMap &map, const TextureView *textures, int numTextures, size_t texels);
+    void setTexture(int t, const TextureView &tex, size_t texels);
+
+    void toggle() { visible = !visible; }
+    bool isVisible() const { return visible; }
+
+    void beginFrame(int columns);
+    /**
+     * setRayEnd - record where the ray of a screen column hit a wall
+     * @column: screen column
+     * @x: map x of the hit
+     * @y: map y of the hit
+     */
+    void setRayEnd(int column, double x, double y)
+    {
+      rayX[column] = float(x);
+      rayY[column] = float(y);
+    }
+    void addSprite(double x, double y);
+
+    void draw(const QuickCG::Canvas &target, double posX, double posY, double dirX, double dirY);
+
+  private:
+    bool visible;
+    int size;      /* Width and height of the minimap in pixels */
+    int cellSize;  /* Pixels per map cell */
+    const WorldMap *map;
+    int mapWidth, mapHeight;
+    Uint32 colors[256];               /* Color of every cell value, wall textures averaged */
+    int numTextures;
+    std::vector<float> rayX, rayY;    /* Wall hit of every screen column this frame */
+    std::vector<float> spriteX, spriteY;
+    QuickCG::DrawList list;
+  };
+}
+
+#endif // __THE_MAZE_MINIMAP_H__
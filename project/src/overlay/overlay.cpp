@@ -0,0 +1,204 @@
+#include "overlay.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace maze
+{
+  static const char *stageNames[NUM_STAGES + 1] =
+      {"floor", "walls", "sprites", "overlay", "present", "frame"};
+
+  static const int PANEL_X = 8;
+  static const int PANEL_Y = 8;
+  static const int LINE_HEIGHT = 10;
+  static const int GRAPH_HEIGHT = 64;
+  static const double GRAPH_MS = 33.3; /* Frame time at the top of the graph */
+
+  /**
+   * now - monotonic time in microseconds
+   * Return: the current time
+   */
+  static double now()
+  {
+    using namespace std::chrono;
+    return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  Overlay::Overlay()
+      : visible(false), frames(0), head(0), frameStart(0), lastRefresh(0)
+  {
+    counters = FrameCounters();
+    std::fill(stageStart, stageStart + NUM_STAGES, 0.0);
+    std::fill(stageTime[0], stageTime[0] + (NUM_STAGES + 1) * HISTORY, 0.0f);
+  }
+
+  /**
+   * toggle - show or hide the overlay
+   * Return: void
+   */
+  void Overlay::toggle()
+  {
+    visible = !visible;
+    lastRefresh = 0;
+  }
+
+  /**
+   * beginFrame - close the previous frame and start a new one
+   *
+   * The frame time is the time between two calls, so it covers everything the
+   * main loop does, including waiting in done().
+   * Return: void
+   */
+  void Overlay::beginFrame()
+  {
+    double t = now();
+    if (frameStart > 0)
+    {
+      stageTime[NUM_STAGES][head] = float((t - frameStart) / 1000.0);
+      head = (head + 1) % HISTORY;
+      if (frames < HISTORY)
+        frames++;
+    }
+    frameStart = t;
+    for (int s = 0; s <= NUM_STAGES; s++)
+      stageTime[s][head] = 0.0f;
+    counters = FrameCounters();
+  }
+
+  /**
+   * beginStage - start timing a render stage
+   * @stage: the stage
+   * Return: void
+   */
+  void Overlay::beginStage(int stage)
+  {
+    stageStart[stage] = now();
+  }
+
+  /**
+   * endStage - stop timing a render stage
+   * @stage: the stage
+   * Return: void
+   */
+  void Overlay::endStage(int stage)
+  {
+    stageTime[stage][head] += float((now() - stageStart[stage]) / 1000.0);
+  }
+
+  /**
+   * summarize - average and percentiles of the recorded history
+   * @samples: ring buffer of HISTORY samples
+   * Return: the summary
+   */
+  Overlay::Summary Overlay::summarize(const float *samples) const
+  {
+    Summary s = {0, 0, 0, 0};
+    if (frames == 0)
+      return s;
+
+    /* Only completed frames: the current slot is still being filled */
+    float sorted[HISTORY];
+    int n = 0;
+    for (int i = 1; i <= frames; i++)
+      sorted[n++] = samples[(head - i + HISTORY) % HISTORY];
+
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+      sum += sorted[i];
+    s.avg = sum / n;
+
+    int k50 = n * 50 / 100, k95 = n * 95 / 100, k99 = n * 99 / 100;
+    std::nth_element(sorted, sorted + k50, sorted + n);
+    s.p50 = sorted[k50];
+    std::nth_element(sorted + k50, sorted + k95, sorted + n);
+    s.p95 = sorted[k95];
+    std::nth_element(sorted + k95, sorted + k99, sorted + n);
+    s.p99 = sorted[k99];
+    return s;
+  }
+
+  /**
+   * refreshText - rebuild the statistics lines
+   * @width: render width
+   * @height: render height
+   * Return: void
+   */
+  void Overlay::refreshText(int width, int height)
+  {
+    char line[64];
+    Summary frame = summarize(stageTime[NUM_STAGES]);
+    double busy = 0;
+
+    snprintf(line, sizeof(line), "FPS %6.1f  %dx%d", frame.avg > 0 ? 1000.0 / frame.avg : 0.0, width, height);
+    lines[0] = line;
+    lines[1] = "          avg   p50   p95   p99";
+    for (int s = 0; s <= NUM_STAGES; s++)
+    {
+      Summary st = summarize(stageTime[s]);
+      if (s < NUM_STAGES)
+        busy += st.avg;
+      snprintf(line, sizeof(line), "%-7s %5.2f %5.2f %5.2f %5.2f", stageNames[s], st.avg, st.p50, st.p95, st.p99);
+      lines[2 + s] = line;
+    }
+    snprintf(line, sizeof(line), "main thread busy %3.0f%%", frame.avg > 0 ? 100.0 * busy / frame.avg : 0.0);
+    lines[NUM_STAGES + 3] = line;
+    snprintf(line, sizeof(line), "rays %d  steps %ld  chunks %d +%d", counters.rays, counters.raySteps,
+             counters.chunksResident, counters.chunkLoads);
+    lines[NUM_STAGES + 4] = line;
+    snprintf(line, sizeof(line), "sprites %d/%d  lights %d  rebaked %d  edits %d", counters.spritesDrawn,
+             counters.spritesTotal, counters.lights, counters.lightCellsBaked, counters.cellsChanged);
+    lines[NUM_STAGES + 5] = line;
+    snprintf(line, sizeof(line), "textures %ld KB  8-bit %d  loading %d", counters.textureBytes / 1024,
+             counters.texturesPaletted, counters.texturesLoading);
+    lines[NUM_STAGES + 6] = line;
+  }
+
+  /**
+   * draw - draw the overlay onto a canvas
+   * @target: the canvas, the screen or a 32-bit render buffer
+   * Return: void
+   */
+  void Overlay::draw(const QuickCG::Canvas &target)
+  {
+    if (!visible)
+      return;
+    beginStage(STAGE_OVERLAY);
+
+    double t = now();
+    if (t - lastRefresh > 250000.0)
+    {
+      refreshText(target.width, target.height);
+      lastRefresh = t;
+    }
+
+    const int numLines = NUM_STAGES + 7;
+    int x1 = PANEL_X, y1 = PANEL_Y;
+    int x2 = x1 + HISTORY + 16, y2 = y1 + numLines * LINE_HEIGHT + GRAPH_HEIGHT + 20;
+
+    list.clear();
+    list.blendRect(x1, y1, x2 - 1, y2 - 1, 0x000000, 128);
+    for (int i = 0; i < numLines; i++)
+      list.printString(lines[i], x1 + 8, y1 + 6 + i * LINE_HEIGHT, 0xFFFFFF);
+
+    /* Frame-time graph, oldest frame on the left */
+    int gx = x1 + 8 + (HISTORY - frames), gy = y1 + 12 + numLines * LINE_HEIGHT + GRAPH_HEIGHT - 1;
+    const float *frame = stageTime[NUM_STAGES];
+    for (int i = 0; i < frames; i++)
+    {
+      float ms = frame[(head - frames + i + HISTORY) % HISTORY];
+      int bar = int(ms * GRAPH_HEIGHT / GRAPH_MS);
+      if (bar > GRAPH_HEIGHT)
+        bar = GRAPH_HEIGHT;
+      if (bar > 0)
+        list.verLine(gx + i, gy - bar + 1, gy, ms < 16.7f ? 0x40E040 : ms < 33.3f ? 0xE0E040 : 0xE04040);
+    }
+
+    /* 60 and 30 FPS guide lines */
+    list.horLine(gy + 1 - int(16.7 * GRAPH_HEIGHT / GRAPH_MS), x1 + 8, x1 + 7 + HISTORY, 0x808080);
+    list.horLine(gy + 1 - GRAPH_HEIGHT, x1 + 8, x1 + 7 + HISTORY, 0x808080);
+
+    list.draw(target);
+    endStage(STAGE_OVERLAY);
+  }
+}
@@ -0,0 +1,95 @@
+/**
+ * @file overlay.hpp
+ * @brief In-game performance overlay with a rolling frame-time graph.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_OVERLAY_H__
+#define __THE_MAZE_OVERLAY_H__
+
+#include <string>
+
+#include "../../../lib/quickcg.h"
+
+namespace maze
+{
+  /**
+   * Render stages timed by the overlay, in the order they run in a frame.
+   */
+  enum Stage
+  {
+    STAGE_FLOOR,
+    STAGE_WALLS,
+    STAGE_SPRITES,
+    STAGE_OVERLAY,
+    STAGE_PRESENT,
+    NUM_STAGES
+  };
+
+  /**
+   * Per-frame counters filled in by the renderer.
+   */
+  struct FrameCounters
+  {
+    int rays;             /* Rays cast by the wall pass */
+    long raySteps;        /* DDA steps taken by all rays */
+    int spritesDrawn;     /* Sprites that produced at least one stripe */
+    int spritesTotal;     /* Sprites considered */
+    long textureBytes;    /* Decoded texture memory resident */
+    int texturesLoading;  /* Textures queued or being decoded */
+    int texturesPaletted; /* Resident textures stored as 8-bit */
+    int lights;           /* Lights in the lightmap */
+    int lightCellsBaked;  /* Lightmap cells rebaked this frame */
+    int chunksResident;   /* Chunks of a streamed world in memory */
+    int chunkLoads;       /* Chunks read from disk this frame */
+    int cellsChanged;     /* Map cells changed this frame */
+  };
+
+  /**
+   * Overlay - toggleable performance overlay.
+   *
+   * Frame and stage times go into fixed-size ring buffers, so there is no
+   * allocation per frame. The text statistics are refreshed a few times per
+   * second to stay readable, the graph is redrawn every frame.
+   */
+  class Overlay
+  {
+  public:
+    static const int HISTORY = 256; /* Frames kept for the graph and the statistics */
+
+    Overlay();
+
+    void toggle();
+    bool isVisible() const { return visible; }
+
+    void beginFrame();
+    void beginStage(int stage);
+    void endStage(int stage);
+
+    void draw(const QuickCG::Canvas &target);
+
+    FrameCounters counters;
+
+  private:
+    struct Summary
+    {
+      double avg, p50, p95, p99;
+    };
+
+    Summary summarize(const float *samples) const;
+    void refreshText(int width, int height);
+
+    bool visible;
+    int frames;                              /* Frames recorded so far, capped at HISTORY */
+    int head;                                /* Ring buffer slot of the current frame */
+    double frameStart;                       /* Start of the current frame, microseconds */
+    double stageStart[NUM_STAGES];
+    float stageTime[NUM_STAGES + 1][HISTORY]; /* Milliseconds; the last row is the whole frame */
+    double lastRefresh;
+    std::string lines[NUM_STAGES + 7];
+    QuickCG::DrawList list; /* Rebuilt every frame, keeps its storage */
+  };
+}
+
+#endif // __THE_MAZE_OVERLAY_H__
@@ -0,0 +1,33 @@
+#include "shading.hpp"
+
+namespace maze
+{
+  /**
+   * Shading - set up the light levels
+   * @range: distance where the last band starts, in cells, all fog from there
+   * @falloff: how fast light falls off with distance
+   * @minLight: light of the far bands, 0 to 1
+   * @sideLight: light of the y-sides of walls relative to the x-sides, 0 to 1
+   * @fogStart: distance where the fog starts
+   */
+  Shading::Shading(double range, double falloff, double minLight, double sideLight, double fogStart)
+      : bandsPerCell((BANDS - 1) / range)
+  {
+    for (int band = 0; band < BANDS; band++)
+    {
+      double distance = (band + 0.5) / bandsPerCell; /* Middle of the band */
+      double light = 1.0 / (1.0 + falloff * distance);
+      if (light < minLight)
+        light = minLight;
+      if (distance > fogStart)
+        light *= distance < range ? (range - distance) / (range - fogStart) : 0;
+      for (int level = 0; level < LIGHTS; level++)
+      {
+        /* Nearest row to the product, in 0-256 units */
+        double front = light * level * 256 / UNIT, side = front * sideLight;
+        rows[band][level] = Uint8(front * (ROWS - 1) / MAX_LIGHT + 0.5);
+        rows[band + BANDS][level] = Uint8(side * (ROWS - 1) / MAX_LIGHT + 0.5);
+      }
+    }
+  }
+}
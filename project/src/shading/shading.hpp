@@ -0,0 +1,196 @@
+/**
+ * @file shading.hpp
+ * @brief Distance, side and baked lighting through precomputed colormaps.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_SHADING_H__
+#define __THE_MAZE_SHADING_H__
+
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+#include "../textures/texture_palette.hpp"
+
+namespace maze
+{
+  /**
+   * Shading - light levels for distance bands and baked light.
+   *
+   * Distances up to the range are split into BANDS bands of constant light,
+   * falling off as 1 / (1 + falloff * distance) down to a minimum, then
+   * fading into the fog, black, from the fog start to the range. Each band
+   * has a second, darker level for the y-sides of walls. A band and a side
+   * together are an attenuation.
+   *
+   * Baked light comes in LIGHTS levels, UNIT being full light and the ones
+   * above it overbright. An attenuation and a baked level select a row: one
+   * of ROWS light levels spread from black to the brightest, a light level
+   * here and a colormap in ShadeTables.
+   */
+  class Shading
+  {
+  public:
+    static const int BANDS = 16;
+    static const int ATTENUATIONS = 2 * BANDS; /* Front bands, then side bands */
+    static const int LIGHTS = 16;              /* Levels of baked light */
+    static const int UNIT = 10;                /* Baked level of full light */
+    static const int ROWS = 49;                /* Light levels of the colormaps, steps of 8 */
+    static const int MAX_LIGHT = 256 * (LIGHTS - 1) / UNIT; /* Light of the last row, 256 is full */
+
+    Shading(double range, double falloff, double minLight, double sideLight, double fogStart);
+
+    /**
+     * attenuation - the attenuation of a distance
+     * @distance: distance from the camera, in cells
+     * @side: true for the y-side of a wall
+     * Return: the attenuation
+     */
+    int attenuation(double distance, bool side = false) const
+    {
+      double position = distance * bandsPerCell;
+      int band = (position >= 0 && position < BANDS - 1) ? int(position) : BANDS - 1; /* Also for the far and the odd */
+      return side ? band + BANDS : band;
+    }
+
+    /**
+     * row - the light row of an attenuation under baked light
+     * @attenuation: see attenuation()
+     * @light: baked level, 0 to LIGHTS - 1
+     * Return: the row
+     */
+    int row(int attenuation, int light = UNIT) const { return rows[attenuation][light]; }
+    int light(int row) const { return row * MAX_LIGHT / (ROWS - 1); }
+
+    /**
+     * scale - a color at a light level, what the tables of ShadeTables hold
+     * @color: the ARGB color
+     * @light: 0 to MAX_LIGHT, channels saturate above 256
+     * Return: the shaded color, alpha kept
+     */
+    static Uint32 scale(Uint32 color, int light)
+    {
+      if (light <= 256)
+        return ((((color & 0xFF00FF) * light) >> 8) & 0xFF00FF) | ((((color & 0x00FF00) * light) >> 8) & 0x00FF00) |
+               (color & 0xFF000000);
+      Uint32 r = (((color >> 16) & 255) * light) >> 8, g = (((color >> 8) & 255) * light) >> 8, b = ((color & 255) * light) >> 8;
+      return (color & 0xFF000000) | (r > 255 ? 255 : r) << 16 | (g > 255 ? 255 : g) << 8 | (b > 255 ? 255 : b);
+    }
+
+  private:
+    double bandsPerCell;
+    Uint8 rows[ATTENUATIONS][LIGHTS]; /* Row of every attenuation and baked level */
+  };
+
+  /**
+   * ShadedTexture - a texture at one light row, as the samplers read it.
+   *
+   * Paletted textures, the ones that passed the quality check of going
+   * 8-bit, go through the colormap of the row: a single lookup that also
+   * packs to the frame format. 32-bit textures are shaded exactly, through
+   * the channel tables of the row: a lookup per channel, then the packing.
+   * Which one it is doesn't change along a wall column, a floor cell or a
+   * sprite, so the test predicts perfectly.
+   */
+  template <class Format>
+  struct ShadedTexture
+  {
+    const typename Format::Type *colormap; /* Row of the slot's colormaps, NULL for a 32-bit texture */
+    const Uint32 *channels;                /* Row of the channel tables: red, green, then blue */
+    TextureView view;
+
+    typename Format::Type operator[](int i) const
+    {
+      if (colormap)
+        return colormap[view.indices[i]];
+      Uint32 c = view.texel(i);
+      return Format::pack((c & 0xFF000000) | channels[(c >> 16) & 255] | channels[256 + ((c >> 8) & 255)] |
+                          channels[512 + (c & 255)]);
+    }
+    /**
+     * opaque - whether a texel is drawn, RGB 0 is the sprite color key
+     * @i: texel index
+     * Return: true unless it is the key
+     */
+    bool opaque(int i) const { return (view.texel(i) & 0x00FFFFFF) != 0; }
+  };
+
+  /**
+   * ShadeTables - the tables that shade texture slots in a frame format.
+   *
+   * Every paletted slot gets ROWS colormaps of 256 entries, mapping an index
+   * straight to the shaded color packed in the frame format: 49 KB per slot
+   * in 32-bit, 25 KB in RGB565 and 12 KB in 8-bit, of which a wall column,
+   * floor cell or sprite touches one row. build() must be called whenever
+   * the texels of a slot change.
+   *
+   * 32-bit slots share one set of channel tables instead: per row, 256
+   * entries for each of red, green and blue, already shifted in place, so
+   * the shaded color is the three ORed together. That is the same color
+   * Shading::scale gives, 3 KB per row and 147 KB in all.
+   */
+  template <class Format>
+  class ShadeTables
+  {
+  public:
+    typedef typename Format::Type Pixel;
+
+    ShadeTables(const Shading &shading, int slots)
+        : shading(shading), tables(slots), palettes(slots, (const Uint32 *)0), channels(Shading::ROWS * 3 * 256)
+    {
+      for (int r = 0; r < Shading::ROWS; r++)
+        for (int i = 0; i < 256; i++)
+        {
+          Uint32 c = Shading::scale(Uint32(i), shading.light(r));
+          channels[r * 768 + i] = c << 16;
+          channels[r * 768 + 256 + i] = c << 8;
+          channels[r * 768 + 512 + i] = c;
+        }
+    }
+
+    /**
+     * build - (re)build the colormaps of a slot
+     * @slot: the slot
+     * @view: its texels now, a 32-bit texture frees the slot's colormaps
+     * Return: void
+     */
+    void build(int slot, const TextureView &view)
+    {
+      palettes[slot] = view.indices ? view.palette : 0;
+      if (!palettes[slot])
+      {
+        std::vector<Pixel>().swap(tables[slot]);
+        return;
+      }
+      tables[slot].resize(Shading::ROWS * 256);
+      for (int r = 0; r < Shading::ROWS; r++)
+        for (int i = 0; i < 256; i++)
+          tables[slot][r * 256 + i] = Format::pack(Shading::scale(view.palette[i], shading.light(r)));
+    }
+
+    /**
+     * get - a slot at a light row
+     * @slot: the slot
+     * @view: its texels now
+     * @row: the light row, see Shading::row
+     * Return: the sampler
+     */
+    ShadedTexture<Format> get(int slot, const TextureView &view, int row) const
+    {
+      ShadedTexture<Format> t;
+      t.colormap = (view.indices && palettes[slot] == view.palette) ? &tables[slot][row * 256] : 0;
+      t.channels = &channels[row * 768];
+      t.view = view;
+      return t;
+    }
+
+  private:
+    const Shading &shading;
+    std::vector<std::vector<Pixel> > tables;
+    std::vector<const Uint32 *> palettes; /* Palette each slot's colormaps were built from */
+    std::vector<Uint32> channels;         /* Channel tables, 768 entries per row */
+  };
+}
+
+#endif // __THE_MAZE_SHADING_H__
@@ -0,0 +1,206 @@
+#include "texture_cache.hpp"
+
+namespace maze
+{
+  /**
+   * hashImage - FNV-1a hash of an image and its size
+   * @pixels: the pixels
+   * @width: image width
+   * @height: image height
+   * Return: the hash
+   */
+  static unsigned long long hashImage(const std::vector<Uint32> &pixels, unsigned long width, unsigned long height)
+  {
+    unsigned long long h = 14695981039346656037ULL;
+    h = (h ^ width) * 1099511628211ULL;
+    h = (h ^ height) * 1099511628211ULL;
+    for (size_t i = 0; i < pixels.size(); i++)
+      h = (h ^ pixels[i]) * 1099511628211ULL;
+    return h;
+  }
+
+  TextureCache::TextureCache() : bytes(0)
+  {
+  }
+
+  /**
+   * insert - take a reference to an image, sharing an identical one if cached
+   * @pixels: the decoded image, swapped into the cache if it is new
+   * @width: image width
+   * @height: image height
+   * @path: file the image came from, or NULL for a generated image
+   * Return: the handle
+   */
+  int TextureCache::insert(std::vector<Uint32> &pixels, unsigned long width, unsigned long height, const std::string *path)
+  {
+    unsigned long long hash = hashImage(pixels, width, height);
+    int handle = -1;
+    std::pair<std::multimap<unsigned long long, int>::iterator, std::multimap<unsigned long long, int>::iterator> range =
+        byHash.equal_range(hash);
+    for (std::multimap<unsigned long long, int>::iterator it = range.first; it != range.second; ++it)
+    {
+      const Entry &e = entries[it->second];
+      if (e.width == width && e.height == height && e.pixels == pixels)
+      {
+        handle = it->second;
+        break;
+      }
+    }
+
+    if (handle < 0)
+    {
+      if (freeHandles.empty())
+      {
+        handle = int(entries.size());
+        entries.push_back(Entry());
+      }
+      else
+      {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+      }
+      Entry &e = entries[handle];
+      e.pixels.swap(pixels);
+      e.width = width;
+      e.height = height;
+      e.hash = hash;
+      e.refs = 0;
+      byHash.insert(std::make_pair(hash, handle));
+      bytes += e.pixels.size() * sizeof(Uint32);
+    }
+
+    Entry &e = entries[handle];
+    e.refs++;
+    if (path)
+    {
+      e.paths.push_back(*path);
+      byPath[*path] = handle;
+    }
+    return handle;
+  }
+
+  /**
+   * acquire - take a reference to the texture of a PNG file
+   * @path: the file
+   * @error: if not NULL, set to the decodePNG error code, 0 on success
+   * Return: the handle, -1 if the file could not be loaded
+   */
+  int TextureCache::acquire(const std::string &path, int *error)
+  {
+    std::vector<std::string> paths(1, path);
+    std::vector<int> handles, errors;
+    acquireAll(paths, handles, &errors);
+    if (error)
+      *error = errors[0];
+    return handles[0];
+  }
+
+  /**
+   * acquireAll - take a reference to the textures of several PNG files
+   * @paths: the files, may repeat
+   * @handles: filled with a handle per path, -1 for the ones that failed
+   * @errors: if not NULL, filled with the decodePNG error code per path
+   *
+   * Paths that are not cached yet are decoded together, in parallel and once
+   * each, see QuickCG::loadImages.
+   * Return: the number of paths that failed
+   */
+  int TextureCache::acquireAll(const std::vector<std::string> &paths, std::vector<int> &handles, std::vector<int> *errors)
+  {
+    handles.assign(paths.size(), -1);
+    if (errors)
+      errors->assign(paths.size(), 0);
+
+    std::vector<QuickCG::ImageRequest> requests;
+    std::vector<size_t> requestPath; /* Path index of each request */
+    std::map<std::string, size_t> requested;
+    for (size_t i = 0; i < paths.size(); i++)
+      if (byPath.find(paths[i]) == byPath.end() && requested.find(paths[i]) == requested.end())
+      {
+        requested[paths[i]] = requests.size();
+        requests.push_back(QuickCG::ImageRequest(int(requests.size()), paths[i]));
+        requestPath.push_back(i);
+      }
+
+    std::vector<std::vector<Uint32> > images(requests.size());
+    if (!requests.empty())
+      QuickCG::loadImages(&images[0], requests);
+    for (size_t r = 0; r < requests.size(); r++)
+      if (!requests[r].error)
+        insert(images[r], requests[r].w, requests[r].h, &requests[r].filename);
+
+    int failed = 0;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+      std::map<std::string, int>::iterator it = byPath.find(paths[i]);
+      if (it == byPath.end())
+      {
+        if (errors)
+          (*errors)[i] = requests[requested[paths[i]]].error;
+        failed++;
+        continue;
+      }
+      handles[i] = it->second;
+      /* The first request of a new path already took its reference in insert */
+      std::map<std::string, size_t>::iterator r = requested.find(paths[i]);
+      if (r != requested.end() && requestPath[r->second] == i)
+        continue;
+      entries[it->second].refs++;
+    }
+    return failed;
+  }
+
+  /**
+   * add - take a reference to a generated texture
+   * @pixels: the image, swapped into the cache if no identical one is cached
+   * @width: image width
+   * @height: image height
+   * Return: the handle
+   */
+  int TextureCache::add(std::vector<Uint32> &pixels, unsigned long width, unsigned long height)
+  {
+    return insert(pixels, width, height, 0);
+  }
+
+  /**
+   * add - take a reference to a texture decoded elsewhere from a file
+   * @pixels: the image, swapped into the cache if no identical one is cached
+   * @width: image width
+   * @height: image height
+   * @path: the file, later acquires of it share this texture
+   * Return: the handle
+   */
+  int TextureCache::add(std::vector<Uint32> &pixels, unsigned long width, unsigned long height, const std::string &path)
+  {
+    return insert(pixels, width, height, &path);
+  }
+
+  /**
+   * release - drop a reference, freeing the texture with the last one
+   * @handle: texture handle, -1 is ignored
+   * Return: void
+   */
+  void TextureCache::release(int handle)
+  {
+    if (handle < 0 || handle >= int(entries.size()) || entries[handle].refs <= 0)
+      return;
+    Entry &e = entries[handle];
+    if (--e.refs > 0)
+      return;
+
+    for (size_t i = 0; i < e.paths.size(); i++)
+      byPath.erase(e.paths[i]);
+    std::pair<std::multimap<unsigned long long, int>::iterator, std::multimap<unsigned long long, int>::iterator> range =
+        byHash.equal_range(e.hash);
+    for (std::multimap<unsigned long long, int>::iterator it = range.first; it != range.second; ++it)
+      if (it->second == handle)
+      {
+        byHash.erase(it);
+        break;
+      }
+    bytes -= e.pixels.size() * sizeof(Uint32);
+    std::vector<Uint32>().swap(e.pixels);
+    e.paths.clear();
+    freeHandles.push_back(handle);
+  }
+}
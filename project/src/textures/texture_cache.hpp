@@ -0,0 +1,71 @@
+/**
+ * @file texture_cache.hpp
+ * @brief Reference-counted texture cache keyed by path and by content.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_TEXTURE_CACHE_H__
+#define __THE_MAZE_TEXTURE_CACHE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+
+namespace maze
+{
+  /**
+   * TextureCache - decoded textures shared between the slots that use them.
+   *
+   * A path is decoded once, however many slots ask for it. Decoded images are
+   * also hashed, so two files (or two generated textures) with the same pixels
+   * end up as one copy. Every acquire takes a reference, release drops it and
+   * the pixels are freed when the last one goes. Handles stay valid until
+   * their last release; pixel pointers too, as entries never move their data.
+   */
+  class TextureCache
+  {
+  public:
+    TextureCache();
+
+    int acquire(const std::string &path, int *error = 0);
+    int acquireAll(const std::vector<std::string> &paths, std::vector<int> &handles, std::vector<int> *errors = 0);
+    int add(std::vector<Uint32> &pixels, unsigned long width, unsigned long height);
+    int add(std::vector<Uint32> &pixels, unsigned long width, unsigned long height, const std::string &path);
+    void release(int handle);
+
+    /**
+     * pixels - the ARGB pixels of a texture, row by row
+     * @handle: texture handle
+     * Return: the pixels
+     */
+    const Uint32 *pixels(int handle) const { return &entries[handle].pixels[0]; }
+    unsigned long width(int handle) const { return entries[handle].width; }
+    unsigned long height(int handle) const { return entries[handle].height; }
+
+    size_t uniqueCount() const { return entries.size() - freeHandles.size(); }
+    size_t residentBytes() const { return bytes; }
+
+  private:
+    struct Entry
+    {
+      std::vector<Uint32> pixels;
+      unsigned long width, height;
+      unsigned long long hash; /* Of the size and pixels */
+      int refs;                /* 0 for a free entry */
+      std::vector<std::string> paths;
+    };
+
+    int insert(std::vector<Uint32> &pixels, unsigned long width, unsigned long height, const std::string *path);
+
+    std::vector<Entry> entries;
+    std::vector<int> freeHandles;
+    std::map<std::string, int> byPath;
+    std::multimap<unsigned long long, int> byHash;
+    size_t bytes; /* Pixel memory of all live entries */
+  };
+}
+
+#endif // __THE_MAZE_TEXTURE_CACHE_H__
@@ -0,0 +1,113 @@
+#include "texture_pack.hpp"
+
+#include <cstring>
+
+namespace maze
+{
+  TexturePack::TexturePack() : data(0), size(0), entries(0), count(0)
+  {
+  }
+
+  TexturePack::~TexturePack()
+  {
+    close();
+  }
+
+  /**
+   * open - map a pack file and check its index
+   * @path: the pack
+   * Return: true if the pack is usable, false if it is missing or invalid
+   */
+  bool TexturePack::open(const std::string &path)
+  {
+    close();
+    /* Read ahead now, the renderer touches every texture in the first frames */
+    if (!file.open(path, QuickCG::MappedFile::ACCESS_WILLNEED) || file.size() < sizeof(PackHeader))
+    {
+      close();
+      return false;
+    }
+    data = file.data();
+    size = file.size();
+
+    const PackHeader *header = (const PackHeader *)data;
+    if (memcmp(header->magic, PACK_MAGIC, 8) != 0 || header->version != PACK_VERSION ||
+        header->byteOrder != PACK_BYTE_ORDER || header->fileSize != size ||
+        header->count > (size - sizeof(PackHeader)) / sizeof(PackEntry))
+    {
+      close();
+      return false;
+    }
+    entries = (const PackEntry *)(data + sizeof(PackHeader));
+    count = header->count;
+    for (Uint32 i = 0; i < count; i++)
+    {
+      const PackEntry &e = entries[i];
+      Uint64 bytes = Uint64(e.width) * e.height * (e.layout == LAYOUT_INDEXED ? 1 : sizeof(Uint32));
+      if (e.layout == LAYOUT_INDEXED)
+        bytes += 256 * sizeof(Uint32);
+      if (memchr(e.name, 0, PACK_NAME_SIZE) == 0 || e.offset % PACK_ALIGN != 0 || e.offset > size || bytes > size - e.offset)
+      {
+        close();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * close - unmap the pack, the pixels it handed out are gone after this
+   * Return: void
+   */
+  void TexturePack::close()
+  {
+    file.close();
+    data = 0;
+    size = 0;
+    entries = 0;
+    count = 0;
+  }
+
+  /**
+   * find - look up an image of the pack
+   * @name: the path it was baked from
+   * @level: mip level
+   * @layout: TextureLayout
+   * @width: if not NULL, set to the width of the image
+   * @height: if not NULL, set to the height of the image
+   * Return: the pixels, NULL if the pack has no such image
+   */
+  const Uint32 *TexturePack::find(const std::string &name, int level, int layout,
+                                  unsigned long *width, unsigned long *height) const
+  {
+    for (Uint32 i = 0; i < count; i++)
+    {
+      const PackEntry &e = entries[i];
+      if (int(e.level) == level && int(e.layout) == layout && name == e.name)
+      {
+        if (width)
+          *width = e.width;
+        if (height)
+          *height = e.height;
+        return (const Uint32 *)(data + e.offset);
+      }
+    }
+    return 0;
+  }
+
+  /**
+   * findIndexed - look up the 8-bit copy of an image of the pack
+   * @name: the path it was baked from
+   * @palette: set to its 256 colors
+   * @width: if not NULL, set to the width of the image
+   * @height: if not NULL, set to the height of the image
+   * Return: the indices, row-major, NULL if the pack has no 8-bit copy
+   */
+  const Uint8 *TexturePack::findIndexed(const std::string &name, const Uint32 **palette,
+                                        unsigned long *width, unsigned long *height) const
+  {
+    const Uint32 *colors = find(name, 0, LAYOUT_INDEXED, width, height);
+    *palette = colors;
+    return colors ? (const Uint8 *)(colors + 256) : 0;
+  }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file texture_pack.hpp
+ * @brief Precompiled texture pack: decoded textures in one mappable file.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_TEXTURE_PACK_H__
+#define __THE_MAZE_TEXTURE_PACK_H__
+
+#include <string>
+
+#include "../../../lib/quickcg.h"
+
+namespace maze
+{
+  /**
+   * Pixel orders stored in a pack. Rows is the order loadImage returns,
+   * columns keeps each texture column contiguous for the wall stripes.
+   * Indexed is the full size image quantized to 256 colors, row-major: the
+   * palette, then one byte per pixel. Only images that quantize within the
+   * error texpack was baked with have one.
+   */
+  enum TextureLayout
+  {
+    LAYOUT_ROWS,
+    LAYOUT_COLUMNS,
+    LAYOUT_INDEXED
+  };
+
+  /*
+   * Pack file layout, all numbers in the byte order of the machine that baked
+   * it (checked through byteOrder):
+   *   PackHeader
+   *   PackEntry[count]          the index, right after the header
+   *   pixel data                every image PACK_ALIGN aligned, ARGB Uint32,
+   *                             or 256 ARGB Uint32 then Uint8 indices
+   * tools/texpack.cpp writes it, TexturePack reads it.
+   */
+  static const char PACK_MAGIC[8] = {'M', 'A', 'Z', 'E', 'P', 'A', 'K', '1'};
+  static const Uint32 PACK_VERSION = 2;
+  static const Uint32 PACK_BYTE_ORDER = 0x01020304;
+  static const Uint32 PACK_ALIGN = 64;
+  static const int PACK_NAME_SIZE = 48;
+
+  struct PackHeader
+  {
+    char magic[8];
+    Uint32 version;
+    Uint32 byteOrder;
+    Uint32 count;     /* Number of entries */
+    Uint32 reserved;
+    Uint64 fileSize;
+  };
+
+  struct PackEntry
+  {
+    char name[PACK_NAME_SIZE]; /* Source path, NUL terminated */
+    Uint32 width, height;      /* Of this level */
+    Uint32 level;              /* Mip level, 0 is the full size image */
+    Uint32 layout;             /* TextureLayout */
+    Uint64 offset;             /* Of the pixels from the start of the file */
+  };
+
+  /**
+   * TexturePack - read-only view of a pack file.
+   *
+   * The file is mapped, not read (unless the system can't map it, see
+   * QuickCG::MappedFile): the pixels handed out point straight into the
+   * mapping and stay valid until close(). Nothing is copied or decoded,
+   * pages come in as the renderer first touches them.
+   */
+  class TexturePack
+  {
+  public:
+    TexturePack();
+    ~TexturePack();
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return data != 0; }
+
+    const Uint32 *find(const std::string &name, int level = 0, int layout = LAYOUT_ROWS,
+                       unsigned long *width = 0, unsigned long *height = 0) const;
+    const Uint8 *findIndexed(const std::string &name, const Uint32 **palette,
+                             unsigned long *width = 0, unsigned long *height = 0) const;
+
+  private:
+    TexturePack(const TexturePack &);
+    TexturePack &operator=(const TexturePack &);
+
+    QuickCG::MappedFile file;
+    const unsigned char *data; /* The mapping, NULL when closed */
+    size_t size;
+    const PackEntry *entries;
+    Uint32 count;
+  };
+}
+
+#endif // __THE_MAZE_TEXTURE_PACK_H__
@@ -0,0 +1,223 @@
+#include "texture_palette.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace maze
+{
+  /* A color and the number of texels that have it */
+  struct ColorCount
+  {
+    Uint32 color;
+    size_t count;
+  };
+
+  /* Colors [begin, end) of the median cut */
+  struct Box
+  {
+    size_t begin, end;
+  };
+
+  /**
+   * channel - one 8-bit channel of an ARGB color
+   * @c: the color
+   * @ch: 0 blue, 1 green, 2 red, 3 alpha
+   * Return: the channel
+   */
+  static int channel(Uint32 c, int ch)
+  {
+    return (c >> (8 * ch)) & 255;
+  }
+
+  /**
+   * isKey - whether a color is the sprite color key
+   * @c: the color
+   *
+   * The sprite pass leaves texels with RGB 0 transparent, so these colors are
+   * kept exact and no other color may be quantized to one of them.
+   * Return: true for RGB 0
+   */
+  static bool isKey(Uint32 c)
+  {
+    return (c & 0xFFFFFF) == 0;
+  }
+
+  /* Orders colors by one channel */
+  struct ByChannel
+  {
+    int ch;
+    bool operator()(const ColorCount &a, const ColorCount &b) const { return channel(a.color, ch) < channel(b.color, ch); }
+  };
+
+  /**
+   * widestChannel - the channel a box spans the most of
+   * @colors: the colors
+   * @box: the box
+   * @range: set to the span of that channel
+   * Return: the channel
+   */
+  static int widestChannel(const std::vector<ColorCount> &colors, const Box &box, int *range)
+  {
+    int best = 0;
+    *range = -1;
+    for (int ch = 0; ch < 4; ch++)
+    {
+      int lo = 255, hi = 0;
+      for (size_t i = box.begin; i < box.end; i++)
+      {
+        lo = std::min(lo, channel(colors[i].color, ch));
+        hi = std::max(hi, channel(colors[i].color, ch));
+      }
+      if (hi - lo > *range)
+      {
+        *range = hi - lo;
+        best = ch;
+      }
+    }
+    return best;
+  }
+
+  /**
+   * medianCut - split colors into at most n boxes of similar colors
+   * @colors: the colors, reordered so every box is contiguous
+   * @n: the number of boxes wanted
+   * Return: the boxes
+   */
+  static std::vector<Box> medianCut(std::vector<ColorCount> &colors, size_t n)
+  {
+    std::vector<Box> boxes;
+    Box all = {0, colors.size()};
+    boxes.push_back(all);
+    while (boxes.size() < n)
+    {
+      /* Split the box spanning the widest range */
+      int split = -1, splitRange = 0, splitChannel = 0;
+      for (size_t b = 0; b < boxes.size(); b++)
+      {
+        if (boxes[b].end - boxes[b].begin < 2)
+          continue;
+        int range, ch = widestChannel(colors, boxes[b], &range);
+        if (range > splitRange)
+        {
+          split = int(b);
+          splitRange = range;
+          splitChannel = ch;
+        }
+      }
+      if (split < 0)
+        break;
+
+      Box &box = boxes[split];
+      ByChannel order = {splitChannel};
+      std::sort(colors.begin() + box.begin, colors.begin() + box.end, order);
+      size_t total = 0, half = 0, middle = box.begin + 1;
+      for (size_t i = box.begin; i < box.end; i++)
+        total += colors[i].count;
+      for (size_t i = box.begin; i + 1 < box.end; i++)
+      {
+        half += colors[i].count;
+        middle = i + 1;
+        if (2 * half >= total)
+          break;
+      }
+      Box upper = {middle, box.end};
+      box.end = middle;
+      boxes.push_back(upper);
+    }
+    return boxes;
+  }
+
+  /**
+   * quantizeTexture - convert a texture to 8-bit indices into 256 colors
+   * @pixels: the ARGB texels
+   * @count: number of texels
+   * @maxError: largest acceptable RMS error per channel, in 0-255 units
+   * @out: filled with the paletted texture, even when the error is too big
+   * @error: if not NULL, set to the RMS error per channel
+   *
+   * Textures with at most 256 colors convert exactly, the others are reduced
+   * by median cut and every color maps to the nearest palette entry. Color
+   * key texels (RGB 0) stay exact.
+   * Return: true if the error is within maxError
+   */
+  bool quantizeTexture(const Uint32 *pixels, size_t count, double maxError, PalettedTexture &out, double *error)
+  {
+    std::map<Uint32, size_t> histogram;
+    for (size_t i = 0; i < count; i++)
+      histogram[pixels[i]]++;
+
+    std::vector<ColorCount> keys, colors;
+    for (std::map<Uint32, size_t>::iterator it = histogram.begin(); it != histogram.end(); ++it)
+    {
+      ColorCount c = {it->first, it->second};
+      (isKey(c.color) ? keys : colors).push_back(c);
+    }
+    std::fill(out.palette, out.palette + 256, 0);
+    out.indices.clear();
+    if (error)
+      *error = 0;
+    if (keys.size() + (colors.empty() ? 0 : 1) > 256)
+      return false;
+
+    /* Keys first, exact; then one entry per box */
+    size_t entries = 0;
+    for (size_t i = 0; i < keys.size() && entries < 256; i++)
+      out.palette[entries++] = keys[i].color;
+    size_t firstColor = entries;
+    std::vector<Box> boxes;
+    if (!colors.empty())
+      boxes = medianCut(colors, 256 - entries);
+    for (size_t b = 0; b < boxes.size(); b++)
+    {
+      double sum[4] = {0, 0, 0, 0};
+      size_t n = 0;
+      for (size_t i = boxes[b].begin; i < boxes[b].end; i++)
+      {
+        for (int ch = 0; ch < 4; ch++)
+          sum[ch] += double(channel(colors[i].color, ch)) * colors[i].count;
+        n += colors[i].count;
+      }
+      Uint32 mean = 0;
+      for (int ch = 0; ch < 4; ch++)
+        mean |= Uint32(sum[ch] / n + 0.5) << (8 * ch);
+      out.palette[entries++] = isKey(mean) ? colors[boxes[b].begin].color : mean;
+    }
+
+    /* Map every color to its entry, keys to themselves and the rest to the nearest color */
+    std::map<Uint32, Uint8> index;
+    double squared = 0;
+    for (size_t i = 0; i < firstColor; i++)
+      index[out.palette[i]] = Uint8(i);
+    for (size_t c = 0; c < colors.size(); c++)
+    {
+      long best = -1;
+      size_t bestEntry = firstColor;
+      for (size_t e = firstColor; e < entries; e++)
+      {
+        long d = 0;
+        for (int ch = 0; ch < 4; ch++)
+        {
+          long diff = channel(colors[c].color, ch) - channel(out.palette[e], ch);
+          d += diff * diff;
+        }
+        if (best < 0 || d < best)
+        {
+          best = d;
+          bestEntry = e;
+        }
+      }
+      index[colors[c].color] = Uint8(bestEntry);
+      squared += double(best) * colors[c].count;
+    }
+
+    out.indices.resize(count);
+    for (size_t i = 0; i < count; i++)
+      out.indices[i] = index[pixels[i]];
+
+    double rms = count ? std::sqrt(squared / (4.0 * count)) : 0;
+    if (error)
+      *error = rms;
+    return rms <= maxError;
+  }
+}
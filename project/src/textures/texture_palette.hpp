@@ -0,0 +1,52 @@
+/**
+ * @file texture_palette.hpp
+ * @brief 8-bit paletted textures and the view the samplers read textures through.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_TEXTURE_PALETTE_H__
+#define __THE_MAZE_TEXTURE_PALETTE_H__
+
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+
+namespace maze
+{
+  /**
+   * PalettedTexture - a texture as one byte per texel into 256 ARGB colors.
+   *
+   * A quarter of the 32-bit size (plus 1 KB of palette), so a 64x64 texture
+   * takes 5 KB instead of 16 KB and the textures of a frame stay in cache.
+   */
+  struct PalettedTexture
+  {
+    std::vector<Uint8> indices;
+    Uint32 palette[256];
+  };
+
+  /**
+   * TextureView - how the samplers see a texture, 32-bit or paletted.
+   *
+   * Exactly one of pixels and indices is set. The test in texel() goes the
+   * same way for a whole wall column or sprite, so it predicts perfectly.
+   */
+  struct TextureView
+  {
+    const Uint32 *pixels;  /* ARGB texels, NULL for a paletted texture */
+    const Uint8 *indices;  /* Palette index of each texel */
+    const Uint32 *palette; /* 256 ARGB colors */
+
+    /**
+     * texel - color of a texel
+     * @i: texel index, row by row
+     * Return: the ARGB color
+     */
+    Uint32 texel(int i) const { return pixels ? pixels[i] : palette[indices[i]]; }
+  };
+
+  bool quantizeTexture(const Uint32 *pixels, size_t count, double maxError, PalettedTexture &out, double *error = 0);
+}
+
+#endif // __THE_MAZE_TEXTURE_PALETTE_H__
@@ -0,0 +1,363 @@
+#include "texture_residency.hpp"
+
+#include <cmath>
+#include <iostream>
+
+namespace maze
+{
+  TextureResidency::TextureResidency(TextureCache &cache, const TexturePack *pack, unsigned long width, unsigned long height,
+                                     Uint32 placeholderColor, size_t budget)
+      : cache(cache), pack(pack), width(width), height(height), placeholder(width * height, placeholderColor),
+        budget(budget), paletteError(-1), frame(0), pending(0), paletted(0), palettedBytes(0), loader(0), quit(false)
+  {
+    mutex = SDL_CreateMutex();
+    wake = SDL_CreateCond();
+  }
+
+  TextureResidency::~TextureResidency()
+  {
+    if (loader)
+    {
+      SDL_mutexP(mutex);
+      quit = true;
+      SDL_CondSignal(wake);
+      SDL_mutexV(mutex);
+      SDL_WaitThread(loader, 0);
+    }
+    for (size_t i = 0; i < resources.size(); i++)
+      if (resources[i].state == RESIDENT)
+      {
+        cache.release(resources[i].handle);
+        delete resources[i].indexed;
+      }
+    for (size_t i = 0; i < done.size(); i++)
+      delete done[i].indexed;
+    SDL_DestroyCond(wake);
+    SDL_DestroyMutex(mutex);
+  }
+
+  /**
+   * addSlot - add a slot showing a texture file
+   * @path: the PNG file, or the name of the texture in the pack
+   *
+   * Slots with the same path share one image. A texture the pack holds at the
+   * slot size is resident at once, as the 8-bit copy baked with it when 8-bit
+   * textures are on and it has one; anything else waits for a request.
+   * Return: the slot
+   */
+  int TextureResidency::addSlot(const std::string &path)
+  {
+    int resource;
+    std::map<std::string, int>::iterator it = byPath.find(path);
+    if (it != byPath.end())
+      resource = it->second;
+    else
+    {
+      resource = int(resources.size());
+      Resource r = {path, ABSENT, {0, 0, 0}, -1, 0, -1, false};
+      unsigned long w = 0, h = 0;
+      const Uint32 *data = (pack && pack->isOpen()) ? pack->find(path, 0, LAYOUT_ROWS, &w, &h) : 0;
+      if (data && w == width && h == height)
+      {
+        r.state = RESIDENT;
+        r.view.pixels = data;
+        const Uint32 *palette = 0;
+        const Uint8 *indices = paletteError >= 0 ? pack->findIndexed(path, &palette, &w, &h) : 0;
+        if (indices && w == width && h == height)
+        {
+          TextureView view = {0, indices, palette};
+          r.view = view;
+          paletted++;
+        }
+      }
+      resources.push_back(r);
+      byPath[path] = resource;
+    }
+
+    TextureView waiting = {&placeholder[0], 0, 0};
+    slots.push_back(resource);
+    views.push_back(resources[resource].state == RESIDENT ? resources[resource].view : waiting);
+    return int(slots.size()) - 1;
+  }
+
+  /**
+   * addSlot - add a slot showing pixels the caller owns, always resident
+   * @pixels: width * height ARGB pixels, valid as long as the slot is used
+   * Return: the slot
+   */
+  int TextureResidency::addSlot(const Uint32 *pixels)
+  {
+    Resource r = {"", RESIDENT, {pixels, 0, 0}, -1, 0, -1, false};
+    resources.push_back(r);
+    slots.push_back(int(resources.size()) - 1);
+    views.push_back(r.view);
+    return int(slots.size()) - 1;
+  }
+
+  /**
+   * setPaletteError - store decoded textures as 8-bit when they quantize well
+   * @maxError: largest RMS error per channel, see quantizeTexture; negative
+   * keeps every texture 32-bit, which is the default
+   *
+   * Call it before adding slots: it also picks how pack textures are
+   * mapped, and the loader thread reads it unlocked.
+   * Return: void
+   */
+  void TextureResidency::setPaletteError(double maxError)
+  {
+    paletteError = maxError;
+  }
+
+  /**
+   * prefetch - a slot will probably be drawn soon, load it if it isn't
+   * @slot: the slot
+   * Return: void
+   */
+  void TextureResidency::prefetch(int slot)
+  {
+    Resource &r = resources[slots[slot]];
+    if (r.lastUsed != frame)
+      use(slots[slot], true);
+  }
+
+  /**
+   * prefetchAhead - prefetch the wall textures of the cells in front of the camera
+   * @map: the map, a cell with value v uses slot v - 1
+   * @posX: camera x
+   * @posY: camera y
+   * @dirX: view direction x
+   * @dirY: view direction y
+   * @distance: how many cells ahead to look
+   *
+   * Looks at a wedge as wide as it is deep, so the walls the camera is
+   * walking or turning towards are decoded before they come into view.
+   * Return: void
+   */
+  void TextureResidency::prefetchAhead(const WorldMap &map, double posX, double posY, double dirX, double dirY, int distance)
+  {
+    double length = std::sqrt(dirX * dirX + dirY * dirY);
+    if (length == 0)
+      return;
+    dirX /= length;
+    dirY /= length;
+    for (int d = 0; d <= distance; d++)
+      for (int side = -d; side <= d; side++)
+      {
+        int x = int(std::floor(posX + dirX * d - dirY * side));
+        int y = int(std::floor(posY + dirY * d + dirX * side));
+        if (!map.inside(x, y))
+          continue;
+        int slot = map.at(x, y) - 1;
+        if (slot >= 0 && slot < int(slots.size()))
+          prefetch(slot);
+      }
+  }
+
+  /**
+   * use - stamp a resource as used and queue it for loading if it isn't resident
+   * @resource: the resource
+   * @prefetchOnly: true for a prefetch, false for a slot that is drawn
+   * Return: void
+   */
+  void TextureResidency::use(int resource, bool prefetchOnly)
+  {
+    Resource &r = resources[resource];
+    r.lastUsed = frame;
+    if (r.state == QUEUED && r.prefetched && !prefetchOnly)
+    {
+      /* Drawn now: move it ahead of the prefetches, unless the loader has it already */
+      r.prefetched = false;
+      SDL_mutexP(mutex);
+      for (std::deque<Job>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end(); ++it)
+        if (it->resource == resource)
+        {
+          visibleQueue.push_back(*it);
+          prefetchQueue.erase(it);
+          break;
+        }
+      SDL_mutexV(mutex);
+      return;
+    }
+    if (r.state != ABSENT)
+      return;
+
+    if (!loader)
+      loader = SDL_CreateThread(loaderMain, this);
+    r.state = QUEUED;
+    r.prefetched = prefetchOnly;
+    pending++;
+    Job job = {resource, r.path};
+    SDL_mutexP(mutex);
+    (prefetchOnly ? prefetchQueue : visibleQueue).push_back(job);
+    SDL_CondSignal(wake);
+    SDL_mutexV(mutex);
+  }
+
+  /**
+   * publish - point the slots of a resource at its texels
+   * @resource: the resource
+   * @view: its texels, NULL to go back to the placeholder
+   * Return: void
+   */
+  void TextureResidency::publish(int resource, const TextureView *view)
+  {
+    TextureView waiting = {&placeholder[0], 0, 0};
+    resources[resource].prefetched = false;
+    for (size_t s = 0; s < slots.size(); s++)
+      if (slots[s] == resource)
+      {
+        views[s] = view ? *view : waiting;
+        if (view)
+          loaded.push_back(int(s));
+      }
+  }
+
+  /**
+   * evict - release least recently used images until the 32-bit and 8-bit
+   * textures together fit the budget
+   *
+   * Only images not needed in the previous frame go, the ones that were are
+   * the working set and stay even if it is bigger than the budget.
+   * Return: void
+   */
+  void TextureResidency::evict()
+  {
+    while (residentBytes() > budget)
+    {
+      int oldest = -1;
+      for (size_t i = 0; i < resources.size(); i++)
+      {
+        const Resource &r = resources[i];
+        if (r.state == RESIDENT && (r.handle >= 0 || r.indexed) && r.lastUsed < frame - 1 &&
+            (oldest < 0 || r.lastUsed < resources[oldest].lastUsed))
+          oldest = int(i);
+      }
+      if (oldest < 0)
+        return;
+      Resource &r = resources[oldest];
+      publish(oldest, 0);
+      if (r.indexed)
+      {
+        palettedBytes -= r.indexed->indices.size() + sizeof(r.indexed->palette);
+        paletted--;
+        delete r.indexed;
+      }
+      cache.release(r.handle);
+      r.state = ABSENT;
+      r.handle = -1;
+      r.indexed = 0;
+    }
+  }
+
+  /**
+   * update - start a frame: publish finished loads and evict over the budget
+   * Return: the slots that became resident, valid until the next update
+   */
+  const std::vector<int> &TextureResidency::update()
+  {
+    frame++;
+    loaded.clear();
+
+    std::vector<Loaded> finished;
+    SDL_mutexP(mutex);
+    finished.swap(done);
+    SDL_mutexV(mutex);
+
+    for (size_t i = 0; i < finished.size(); i++)
+    {
+      Loaded &l = finished[i];
+      Resource &r = resources[l.resource];
+      pending--;
+      if (l.error || l.width != width || l.height != height)
+      {
+        if (l.error)
+          std::cout << "Error loading " << r.path << " (error " << l.error << ")" << std::endl;
+        else
+          std::cout << "Error loading " << r.path << " (" << l.width << "x" << l.height << ", expected "
+                    << width << "x" << height << ")" << std::endl;
+        r.state = FAILED;
+        delete l.indexed;
+        continue;
+      }
+      r.state = RESIDENT;
+      if (l.indexed)
+      {
+        r.indexed = l.indexed;
+        TextureView view = {0, &r.indexed->indices[0], r.indexed->palette};
+        r.view = view;
+        palettedBytes += r.indexed->indices.size() + sizeof(r.indexed->palette);
+        paletted++;
+      }
+      else
+      {
+        r.handle = cache.add(l.pixels, l.width, l.height, r.path);
+        TextureView view = {cache.pixels(r.handle), 0, 0};
+        r.view = view;
+      }
+      publish(l.resource, &r.view);
+    }
+
+    evict();
+    return loaded;
+  }
+
+  int TextureResidency::loaderMain(void *data)
+  {
+    ((TextureResidency *)data)->loaderLoop();
+    return 0;
+  }
+
+  /**
+   * loaderLoop - decode queued files until the residency is destroyed
+   *
+   * Runs on the loader thread. It only touches the queues and the done list,
+   * under the mutex; everything else belongs to the main thread.
+   * Return: void
+   */
+  void TextureResidency::loaderLoop()
+  {
+    SDL_mutexP(mutex);
+    for (;;)
+    {
+      while (!quit && visibleQueue.empty() && prefetchQueue.empty())
+        SDL_CondWait(wake, mutex);
+      if (quit)
+        break;
+      std::deque<Job> &queue = visibleQueue.empty() ? prefetchQueue : visibleQueue;
+      Job job = queue.front();
+      queue.pop_front();
+      SDL_mutexV(mutex);
+
+      std::vector<QuickCG::ImageRequest> requests(1, QuickCG::ImageRequest(0, job.path));
+      Loaded l;
+      QuickCG::loadImages(&l.pixels, requests, 1);
+      l.resource = job.resource;
+      l.width = requests[0].w;
+      l.height = requests[0].h;
+      l.error = requests[0].error;
+      l.indexed = 0;
+      if (!l.error && paletteError >= 0 && l.width == width && l.height == height)
+      {
+        /* Quantize here, off the main thread; keep 32 bits if it looks too different */
+        l.indexed = new PalettedTexture;
+        if (quantizeTexture(&l.pixels[0], l.pixels.size(), paletteError, *l.indexed))
+          std::vector<Uint32>().swap(l.pixels);
+        else
+        {
+          delete l.indexed;
+          l.indexed = 0;
+        }
+      }
+
+      SDL_mutexP(mutex);
+      done.push_back(Loaded());
+      done.back().pixels.swap(l.pixels);
+      done.back().indexed = l.indexed;
+      done.back().resource = l.resource;
+      done.back().width = l.width;
+      done.back().height = l.height;
+      done.back().error = l.error;
+    }
+    SDL_mutexV(mutex);
+  }
+}
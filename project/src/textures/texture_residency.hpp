@@ -0,0 +1,165 @@
+/**
+ * @file texture_residency.hpp
+ * @brief Texture slots that load in the background when they are first needed.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_TEXTURE_RESIDENCY_H__
+#define __THE_MAZE_TEXTURE_RESIDENCY_H__
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+#include "texture_cache.hpp"
+#include "texture_pack.hpp"
+#include "texture_palette.hpp"
+#include "../world/world_map.hpp"
+
+namespace maze
+{
+  /**
+   * TextureResidency - lazily resident texture slots.
+   *
+   * Nothing is decoded up front: a slot renders with a flat placeholder until
+   * the renderer request()s it (it came into view) or prefetch()es it (it is
+   * near the camera's heading). It is then decoded by a background thread and
+   * published by update() at the start of a frame, visible requests before
+   * prefetches. Slots found in the pack are mapped, so they are resident as
+   * soon as they are added.
+   *
+   * Decoded images live in the TextureCache, so slots and paths that share an
+   * image share its memory. When the decoded images, 32-bit ones in the cache
+   * and 8-bit ones alike, take more than the budget, update() releases the
+   * least recently used images that were not needed in the previous frame;
+   * their slots go back to the placeholder and load again the next time they
+   * are requested. Pack textures are mapped and cost no heap, they are never
+   * evicted.
+   *
+   * With setPaletteError(), decoded textures are quantized to 8-bit indices
+   * by the loader thread; the ones that don't quantize within the error stay
+   * 32-bit. Pack textures are mapped as the 8-bit copy texpack baked for the
+   * ones within its own error, the others stay 32-bit, and caller owned
+   * pixels are always 32-bit. Only 8-bit textures have indices: the
+   * colormaps shade those, 32-bit ones are shaded exactly (see ShadeTables).
+   *
+   * The table of views only changes in update(), so the renderer can sample
+   * through it for the rest of the frame. Every slot has the same size.
+   */
+  class TextureResidency
+  {
+  public:
+    TextureResidency(TextureCache &cache, const TexturePack *pack, unsigned long width, unsigned long height,
+                     Uint32 placeholderColor, size_t budget);
+    ~TextureResidency();
+
+    int addSlot(const std::string &path);
+    int addSlot(const Uint32 *pixels);
+
+    void setPaletteError(double maxError);
+
+    /**
+     * table - texels of every slot, the placeholder for the ones not resident
+     * Return: the table, indexed by slot
+     */
+    const TextureView *table() const { return &views[0]; }
+    bool isResident(int slot) const { return views[slot].pixels != &placeholder[0]; }
+
+    /**
+     * request - a slot is used for drawing this frame
+     * @slot: the slot
+     */
+    void request(int slot)
+    {
+      Resource &r = resources[slots[slot]];
+      if (r.lastUsed != frame || r.prefetched)
+        use(slots[slot], false);
+    }
+    void prefetch(int slot);
+    void prefetchAhead(const WorldMap &map, double posX, double posY, double dirX, double dirY, int distance);
+
+    const std::vector<int> &update();
+
+    size_t residentBytes() const { return cache.residentBytes() + palettedBytes; }
+    int pendingCount() const { return pending; }
+    int palettedCount() const { return paletted; }
+
+  private:
+    TextureResidency(const TextureResidency &);
+    TextureResidency &operator=(const TextureResidency &);
+
+    enum State
+    {
+      ABSENT,   /* Not loaded, not queued */
+      QUEUED,   /* Waiting for or being decoded by the loader */
+      RESIDENT, /* Pixels published in the table */
+      FAILED    /* The file could not be loaded, stays on the placeholder */
+    };
+
+    /* One image, shared by the slots with the same path */
+    struct Resource
+    {
+      std::string path;
+      State state;
+      TextureView view;         /* Resident texels */
+      int handle;               /* Cache handle of 32-bit texels, -1 if none */
+      PalettedTexture *indexed; /* Owned 8-bit texels, NULL if none */
+      long lastUsed;            /* Frame of the last request or prefetch */
+      bool prefetched;          /* Queued by prefetch only, a request moves it to the visible queue */
+    };
+
+    /* A decode for the loader thread; the path is copied, resources may grow meanwhile */
+    struct Job
+    {
+      int resource;
+      std::string path;
+    };
+
+    /* A decode finished by the loader thread */
+    struct Loaded
+    {
+      int resource;
+      std::vector<Uint32> pixels;
+      PalettedTexture *indexed; /* Set instead of pixels when quantized */
+      unsigned long width, height;
+      int error;
+    };
+
+    void use(int resource, bool prefetchOnly);
+    void publish(int resource, const TextureView *view);
+    void evict();
+    static int loaderMain(void *data);
+    void loaderLoop();
+
+    TextureCache &cache;
+    const TexturePack *pack;
+    unsigned long width, height;
+    std::vector<Uint32> placeholder;
+    size_t budget;       /* Bytes of decoded images to keep resident */
+    double paletteError; /* RMS error allowed for 8-bit textures, negative for none */
+    long frame;
+
+    std::vector<int> slots;              /* Resource of every slot */
+    std::vector<TextureView> views;      /* The table */
+    std::vector<Resource> resources;
+    std::map<std::string, int> byPath;
+    std::vector<int> loaded;             /* Slots published by the last update() */
+    int pending;                         /* Resources queued or being decoded */
+    int paletted;                        /* Resident 8-bit resources */
+    size_t palettedBytes;                /* Memory of the owned ones */
+
+    /* Shared with the loader thread, under mutex */
+    SDL_mutex *mutex;
+    SDL_cond *wake;
+    SDL_Thread *loader;
+    bool quit;
+    std::deque<Job> visibleQueue;  /* Resources requested for drawing */
+    std::deque<Job> prefetchQueue; /* Resources only prefetched */
+    std::vector<Loaded> done;
+  };
+}
+
+#endif // __THE_MAZE_TEXTURE_RESIDENCY_H__
@@ -0,0 +1,399 @@
+#include "chunked_world.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace maze
+{
+  /**
+   * ChunkedWorld - a closed world
+   * @budget: bytes of chunks kept in memory, at least a few chunks are
+   */
+  ChunkedWorld::ChunkedWorld(size_t budget)
+      : mapWidth(0), mapHeight(0), chunksWide(0), chunksHigh(0), tick(0), lastX(-1), lastY(-1), last(0), loads(0)
+  {
+    size_t count = budget / sizeof(Chunk);
+    chunks.resize(count < 4 ? 4 : count);
+    Slot free = {FREE, 0};
+    slots.assign(chunks.size(), free);
+    memset(&head, 0, sizeof(head));
+  }
+
+  /**
+   * open - open a chunk file and check its header, no chunk is read yet
+   * @path: the chunk file
+   * Return: true if the world is usable, false if it is missing or invalid
+   */
+  bool ChunkedWorld::open(const std::string &path)
+  {
+    close();
+    file.open(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open())
+      return false;
+    file.seekg(0, std::ios::end);
+    Uint64 size = Uint64(file.tellg());
+    file.seekg(0, std::ios::beg);
+    if (size < sizeof(ChunksHeader) || !file.read((char *)&head, sizeof(head)))
+    {
+      close();
+      return false;
+    }
+
+    /* The chunks themselves are checked as they are read, a world can be too big to look at here */
+    Uint64 wide = (Uint64(head.width) + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    Uint64 high = (Uint64(head.height) + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    if (memcmp(head.magic, CHUNKS_MAGIC, 8) != 0 || head.version != CHUNKS_VERSION ||
+        head.byteOrder != CHUNKS_BYTE_ORDER || head.chunkSize != Uint32(CHUNK_SIZE) || head.fileSize != size ||
+        head.width < 1 || head.width > 0x7fffffff || head.height < 1 || head.height > 0x7fffffff ||
+        head.chunksOffset % CHUNKS_ALIGN != 0 || head.chunksOffset < sizeof(ChunksHeader) || head.chunksOffset > size ||
+        wide * high > (size - head.chunksOffset) / sizeof(Chunk) ||
+        !(head.spawnX >= 0 && head.spawnX < head.width && head.spawnY >= 0 && head.spawnY < head.height) ||
+        (head.spawnDirX == 0 && head.spawnDirY == 0))
+    {
+      close();
+      return false;
+    }
+    mapWidth = int(head.width);
+    mapHeight = int(head.height);
+    chunksWide = int(wide);
+    chunksHigh = int(high);
+    return true;
+  }
+
+  /**
+   * close - close the file and drop every chunk
+   * Return: void
+   */
+  void ChunkedWorld::close()
+  {
+    if (file.is_open())
+      file.close();
+    file.clear();
+    memset(&head, 0, sizeof(head));
+    mapWidth = mapHeight = chunksWide = chunksHigh = 0;
+    for (size_t i = 0; i < slots.size(); i++)
+      slots[i].key = FREE;
+    byKey.clear();
+    edits.clear();
+    lastX = lastY = -1;
+    last = 0;
+  }
+
+  /**
+   * find - the slot of a chunk, reading it into the least recently used one
+   * if it isn't resident
+   * @cx: chunk x
+   * @cy: chunk y
+   * Return: the chunk, it is also the last one now
+   */
+  Chunk *ChunkedWorld::find(int cx, int cy)
+  {
+    Uint64 key = Uint64(cx) * chunksHigh + cy;
+    std::map<Uint64, int>::iterator it = byKey.find(key);
+    int slot;
+    if (it != byKey.end())
+      slot = it->second;
+    else
+    {
+      slot = 0;
+      for (size_t i = 1; i < slots.size(); i++)
+        if (slots[i].key == FREE || (slots[slot].key != FREE && slots[i].used < slots[slot].used))
+          slot = int(i);
+      if (slots[slot].key != FREE)
+        byKey.erase(slots[slot].key);
+      load(slot, cx, cy);
+      slots[slot].key = key;
+      byKey[key] = slot;
+    }
+    slots[slot].used = ++tick;
+    lastX = cx;
+    lastY = cy;
+    last = &chunks[slot];
+    return last;
+  }
+
+  /**
+   * put - change a cell of a chunk and its occupancy
+   * @chunk: the chunk
+   * @cell: index of the cell in the chunk's cells
+   * @value: 0 for empty, the texture slot + 1 for a wall
+   * Return: void
+   */
+  static void put(Chunk &chunk, int cell, Uint8 value)
+  {
+    int block = cell >> 6;
+    Uint64 bit = Uint64(1) << (cell & 63);
+    chunk.cells[cell] = value;
+    chunk.blocks[block] = value ? chunk.blocks[block] | bit : chunk.blocks[block] & ~bit;
+    chunk.super = chunk.blocks[block] ? chunk.super | Uint64(1) << block : chunk.super & ~(Uint64(1) << block);
+  }
+
+  /**
+   * load - read a chunk from the file, with the cells changed since
+   * @slot: where to put it
+   * @cx: chunk x
+   * @cy: chunk y
+   * Return: void
+   */
+  void ChunkedWorld::load(int slot, int cx, int cy)
+  {
+    Chunk &chunk = chunks[slot];
+    Uint64 key = Uint64(cx) * chunksHigh + cy;
+    file.clear();
+    file.seekg(std::streamoff(head.chunksOffset + key * sizeof(Chunk)), std::ios::beg);
+    loads++;
+    if (!file.read((char *)&chunk, sizeof(Chunk)))
+    {
+      /* A chunk that can't be read is walls, rays stop there and nobody walks in */
+      memset(chunk.cells, 1, sizeof(chunk.cells));
+      memset(chunk.blocks, 0xff, sizeof(chunk.blocks));
+      chunk.super = ~Uint64(0);
+    }
+    std::map<Uint64, Uint8>::const_iterator it = edits.lower_bound(key * CHUNK_CELLS);
+    for (; it != edits.end() && it->first < (key + 1) * CHUNK_CELLS; ++it)
+      put(chunk, int(it->first - key * CHUNK_CELLS), it->second);
+  }
+
+  /**
+   * set - change a cell, for as long as the world is open
+   * @x: cell x, inside the map
+   * @y: cell y, inside the map
+   * @value: 0 for empty, the texture slot + 1 for a wall
+   * Return: void
+   */
+  void ChunkedWorld::set(int x, int y, Uint8 value)
+  {
+    int cell = (((x >> 3) & 7) * 8 + ((y >> 3) & 7)) << 6 | (x & 7) << 3 | (y & 7);
+    put(*chunkAt(x, y), cell, value);
+    edits[(Uint64(x >> CHUNK_SHIFT) * chunksHigh + (y >> CHUNK_SHIFT)) * CHUNK_CELLS + cell] = value;
+  }
+
+  /**
+   * cast - follow a ray to the first wall, see castRay()
+   * @posX: start x, inside the map
+   * @posY: start y, inside the map
+   * @rayDirX: direction x, the distances are in units of its length
+   * @rayDirY: direction y
+   * @maxDistance: distance to give up at
+   * Return: the wall, if any
+   */
+  RayHit ChunkedWorld::cast(double posX, double posY, double rayDirX, double rayDirY, double maxDistance)
+  {
+    return castRay(*this, posX, posY, rayDirX, rayDirY, maxDistance);
+  }
+
+  /**
+   * prefetch - read the chunks around a position and ahead of it
+   * @posX: position x
+   * @posY: position y
+   * @dirX: heading x, any length
+   * @dirY: heading y
+   * @distance: how far ahead, in cells
+   *
+   * Every chunk along the heading, with the ones beside it, from the
+   * distance back to the position in steps of half a chunk; the last step
+   * is always the position itself. The nearest go last, so they are the last
+   * the LRU would give up.
+   * Return: void
+   */
+  void ChunkedWorld::prefetch(double posX, double posY, double dirX, double dirY, double distance)
+  {
+    double length = std::sqrt(dirX * dirX + dirY * dirY);
+    if (!isOpen() || length == 0)
+      return;
+    for (double d = distance > 0 ? distance : 0;; d = d > CHUNK_SIZE / 2 ? d - CHUNK_SIZE / 2 : 0)
+    {
+      int cx = int(std::floor((posX + dirX / length * d) / CHUNK_SIZE));
+      int cy = int(std::floor((posY + dirY / length * d) / CHUNK_SIZE));
+      for (int x = cx - 1; x <= cx + 1; x++)
+        for (int y = cy - 1; y <= cy + 1; y++)
+          if (x >= 0 && y >= 0 && x < chunksWide && y < chunksHigh)
+            find(x, y);
+      if (d == 0)
+        break;
+    }
+  }
+
+  /**
+   * takeLoads - chunks read from the file since the last call
+   * Return: the count
+   */
+  int ChunkedWorld::takeLoads()
+  {
+    int count = loads;
+    loads = 0;
+    return count;
+  }
+
+  /**
+   * save - write a chunk file from a map in memory
+   * @path: the file
+   * @map: the cells, chunked with their occupancy
+   * @spawnX: where the player starts, x
+   * @spawnY: where the player starts, y
+   * @spawnDirX: where the player looks, x
+   * @spawnDirY: where the player looks, y
+   *
+   * Goes through ChunkWriter a row at a time, the file is never all in
+   * memory, but the map is: a world larger than memory is written with
+   * ChunkWriter directly.
+   * Return: true if the file was written
+   */
+  bool ChunkedWorld::save(const std::string &path, const WorldMap &map, double spawnX, double spawnY,
+                          double spawnDirX, double spawnDirY)
+  {
+    ChunkWriter writer;
+    if (!writer.open(path, map.width(), map.height()))
+      return false;
+    std::vector<Uint8> row(map.height());
+    for (int x = 0; x < map.width(); x++)
+    {
+      for (int y = 0; y < map.height(); y++)
+        row[y] = map.at(x, y);
+      writer.writeRow(&row[0]);
+    }
+    return writer.close(spawnX, spawnY, spawnDirX, spawnDirY);
+  }
+
+  /**
+   * ChunkWriter - a writer with no file
+   */
+  ChunkWriter::ChunkWriter() : mapWidth(0), mapHeight(0), rows(0)
+  {
+    memset(&head, 0, sizeof(head));
+  }
+
+  /**
+   * ~ChunkWriter - drop the file if close() didn't finish it
+   */
+  ChunkWriter::~ChunkWriter()
+  {
+    if (out.is_open())
+    {
+      out.close();
+      std::remove((path + ".part").c_str());
+    }
+  }
+
+  /**
+   * open - start a chunk file, its chunks come with writeRow()
+   * @path: the file
+   * @width: of the world, in cells
+   * @height: of the world, in cells
+   *
+   * It is written as path.part, with room for the header at the start, and
+   * only replaces path once close() has filled it in.
+   * Return: true if the file could be created
+   */
+  bool ChunkWriter::open(const std::string &path, int width, int height)
+  {
+    if (out.is_open() || width < 1 || height < 1)
+      return false;
+    out.open((path + ".part").c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+      return false;
+    this->path = path;
+    mapWidth = width;
+    mapHeight = height;
+    rows = 0;
+    band.assign(size_t(CHUNK_SIZE) * height, 0);
+
+    int wide = (width + CHUNK_SIZE - 1) >> CHUNK_SHIFT, high = (height + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, CHUNKS_MAGIC, 8);
+    head.version = CHUNKS_VERSION;
+    head.byteOrder = CHUNKS_BYTE_ORDER;
+    head.width = Uint32(width);
+    head.height = Uint32(height);
+    head.chunkSize = CHUNK_SIZE;
+    head.chunksOffset = (sizeof(ChunksHeader) + CHUNKS_ALIGN - 1) / CHUNKS_ALIGN * CHUNKS_ALIGN;
+    head.fileSize = head.chunksOffset + Uint64(wide) * high * sizeof(Chunk);
+
+    /* Zeros until close() */
+    std::vector<char> zeros(size_t(head.chunksOffset), 0);
+    out.write(&zeros[0], std::streamsize(zeros.size()));
+    return out.good();
+  }
+
+  /**
+   * writeRow - add the next row of cells
+   * @values: height values, cell (x, 0) to (x, height - 1) of row x
+   *
+   * Rows past the width are dropped.
+   * Return: void
+   */
+  void ChunkWriter::writeRow(const Uint8 *values)
+  {
+    if (!out.is_open() || rows == mapWidth)
+      return;
+    memcpy(&band[size_t(rows % CHUNK_SIZE) * mapHeight], values, size_t(mapHeight));
+    rows++;
+    if (rows % CHUNK_SIZE == 0 || rows == mapWidth)
+      writeBand();
+  }
+
+  /**
+   * writeBand - build and write the chunks of the band just filled
+   *
+   * The last band may be short, its missing rows are empty.
+   * Return: void
+   */
+  void ChunkWriter::writeBand()
+  {
+    int x0 = (rows - 1) & ~(CHUNK_SIZE - 1), count = rows - x0;
+    int high = (mapHeight + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    Chunk chunk;
+    for (int cy = 0; cy < high; cy++)
+    {
+      memset(&chunk, 0, sizeof(chunk));
+      for (int i = 0; i < count; i++)
+        for (int y = cy * CHUNK_SIZE; y < (cy + 1) * CHUNK_SIZE && y < mapHeight; y++)
+        {
+          int x = x0 + i, block = ((x >> 3) & 7) * 8 + ((y >> 3) & 7);
+          Uint8 value = band[size_t(i) * mapHeight + y];
+          chunk.cells[block << 6 | (x & 7) << 3 | (y & 7)] = value;
+          if (value)
+          {
+            chunk.blocks[block] |= Uint64(1) << ((x & 7) << 3 | (y & 7));
+            chunk.super |= Uint64(1) << block;
+          }
+        }
+      out.write((const char *)&chunk, sizeof(chunk));
+    }
+  }
+
+  /**
+   * close - finish the file with its header and put it in place
+   * @spawnX: where the player starts, x
+   * @spawnY: where the player starts, y
+   * @spawnDirX: where the player looks, x
+   * @spawnDirY: where the player looks, y
+   * Return: true if every row was written and so was the file; otherwise
+   * it is dropped, and a file that was at the path before stays
+   */
+  bool ChunkWriter::close(double spawnX, double spawnY, double spawnDirX, double spawnDirY)
+  {
+    if (!out.is_open())
+      return false;
+    if (rows != mapWidth)
+    {
+      out.close();
+      std::remove((path + ".part").c_str());
+      return false;
+    }
+    head.spawnX = spawnX;
+    head.spawnY = spawnY;
+    head.spawnDirX = spawnDirX;
+    head.spawnDirY = spawnDirY;
+    out.seekp(0);
+    out.write((const char *)&head, sizeof(head));
+    out.close();
+    if (out.fail() || std::rename((path + ".part").c_str(), path.c_str()) != 0)
+    {
+      std::remove((path + ".part").c_str());
+      return false;
+    }
+    return true;
+  }
+}
@@ -0,0 +1,204 @@
+/**
+ * @file chunked_world.hpp
+ * @brief Worlds streamed from disk in chunks, for maps larger than memory.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_CHUNKED_WORLD_H__
+#define __THE_MAZE_CHUNKED_WORLD_H__
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+#include "occupancy_grid.hpp"
+#include "world_map.hpp"
+
+namespace maze
+{
+  /*
+   * Chunk file layout, all numbers in the byte order of the machine that baked
+   * it (checked through byteOrder):
+   *   ChunksHeader
+   *   Chunk[chunksWide * chunksHigh]  chunk (cx, cy) at cx * chunksHigh + cy,
+   *                                   from chunksOffset, CHUNKS_ALIGN aligned
+   * tools/mapbake.cpp writes it through ChunkWriter, ChunkedWorld reads it.
+   */
+  static const char CHUNKS_MAGIC[8] = {'M', 'A', 'Z', 'E', 'C', 'H', 'K', '1'};
+  static const Uint32 CHUNKS_VERSION = 1;
+  static const Uint32 CHUNKS_BYTE_ORDER = 0x01020304;
+  static const Uint32 CHUNKS_ALIGN = 64;
+  static const int CHUNK_SHIFT = 6; /* A chunk is one 64x64 super-block of the occupancy pyramid */
+  static const int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+  static const int CHUNK_CELLS = CHUNK_SIZE * CHUNK_SIZE;
+
+  struct ChunksHeader
+  {
+    char magic[8];
+    Uint32 version;
+    Uint32 byteOrder;
+    Uint32 width, height;         /* In cells, any size */
+    Uint32 chunkSize;             /* CHUNK_SIZE */
+    Uint32 reserved;
+    double spawnX, spawnY;        /* Where the player starts */
+    double spawnDirX, spawnDirY;  /* Where the player looks */
+    Uint64 chunksOffset;
+    Uint64 fileSize;
+  };
+
+  /**
+   * Chunk - 64x64 cells with their occupancy, as stored on disk and in memory.
+   * Cells past the edge of the map are empty.
+   */
+  struct Chunk
+  {
+    Uint8 cells[CHUNK_CELLS];             /* 8x8 tiles, as WorldMap::LAYOUT_TILED */
+    Uint64 blocks[64];                    /* Bits as in OccupancyGrid, block (bx, by) at bx * 8 + by */
+    Uint64 super;                         /* Bit bx * 8 + by for a block with a wall */
+    Uint64 reserved[7];                   /* Up to a multiple of CHUNKS_ALIGN */
+  };
+
+  /**
+   * ChunkedWorld - a map read from a chunk file as rays and players get to it.
+   *
+   * Only the chunks in use are in memory, in a fixed pool of slots sized by
+   * the budget: a chunk that isn't resident is read into the least recently
+   * used slot when first needed, so memory stays the same however large the
+   * world is. Changed cells are kept aside, not written to the file, and
+   * put back into their chunk whenever it is read again. prefetch() reads
+   * the chunks ahead of the camera before the frame, so the wall pass rarely
+   * waits for the disk.
+   *
+   * A chunk is a super-block, so rays cross it with the same pyramid jumps
+   * as an in-memory map (castRay()). The last chunk looked up is kept: a ray
+   * only looks a chunk up when it crosses into another one, not per cell.
+   * Chunks that can't be read are solid walls.
+   *
+   * Chunk files are written by ChunkWriter, a band of chunks at a time, or
+   * by save() from a map already in memory.
+   */
+  class ChunkedWorld
+  {
+  public:
+    explicit ChunkedWorld(size_t budget);
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return file.is_open(); }
+    const ChunksHeader &header() const { return head; }
+
+    int width() const { return mapWidth; }
+    int height() const { return mapHeight; }
+    bool inside(int x, int y) const { return x >= 0 && y >= 0 && x < mapWidth && y < mapHeight; }
+
+    /**
+     * at - the value of a cell, reading its chunk if needed
+     * @x: cell x, inside the map
+     * @y: cell y, inside the map
+     * Return: 0 for empty, the texture slot + 1 for a wall
+     */
+    Uint8 at(int x, int y)
+    {
+      return chunkAt(x, y)->cells[(((x >> 3) & 7) * 8 + ((y >> 3) & 7)) << 6 | (x & 7) << 3 | (y & 7)];
+    }
+    bool wall(int x, int y)
+    {
+      return (chunkAt(x, y)->blocks[((x >> 3) & 7) * 8 + ((y >> 3) & 7)] >> ((x & 7) << 3 | (y & 7))) & 1;
+    }
+    bool walkable(int x, int y) { return inside(x, y) && !wall(x, y); }
+    bool blockEmpty(int x, int y) { return !chunkAt(x, y)->blocks[((x >> 3) & 7) * 8 + ((y >> 3) & 7)]; }
+    bool superEmpty(int x, int y) { return !chunkAt(x, y)->super; }
+    void set(int x, int y, Uint8 value);
+
+    RayHit cast(double posX, double posY, double rayDirX, double rayDirY, double maxDistance);
+    void prefetch(double posX, double posY, double dirX, double dirY, double distance);
+
+    int residentCount() const { return int(byKey.size()); }
+    int takeLoads();
+
+    static bool save(const std::string &path, const WorldMap &map, double spawnX, double spawnY,
+                     double spawnDirX, double spawnDirY);
+
+  private:
+    ChunkedWorld(const ChunkedWorld &);
+    ChunkedWorld &operator=(const ChunkedWorld &);
+
+    /**
+     * chunkAt - the chunk of a cell, the fast path when it is the last one
+     * @x: cell x, inside the map
+     * @y: cell y, inside the map
+     * Return: the chunk, resident until other chunks are needed
+     */
+    Chunk *chunkAt(int x, int y)
+    {
+      if ((x >> CHUNK_SHIFT) == lastX && (y >> CHUNK_SHIFT) == lastY)
+        return last;
+      return find(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    }
+    Chunk *find(int cx, int cy);
+    void load(int slot, int cx, int cy);
+
+    static const Uint64 FREE = ~Uint64(0);
+
+    struct Slot
+    {
+      Uint64 key;    /* cx * chunksHigh + cy of the chunk in it, FREE if none */
+      Uint64 used;   /* Tick of the last lookup */
+    };
+
+    std::ifstream file;
+    ChunksHeader head;
+    int mapWidth, mapHeight;
+    int chunksWide, chunksHigh;
+    std::vector<Chunk> chunks;  /* The pool */
+    std::vector<Slot> slots;
+    std::map<Uint64, int> byKey; /* Slot of every resident chunk */
+    Uint64 tick;
+    int lastX, lastY;            /* Chunk of the last lookup */
+    Chunk *last;
+    int loads;                   /* Chunks read since takeLoads() */
+    /* Changed cells, at the chunk's key * CHUNK_CELLS + the cell's index in it */
+    std::map<Uint64, Uint8> edits;
+  };
+
+  /**
+   * ChunkWriter - writes a chunk file a row of cells at a time.
+   *
+   * Rows come in order, x from 0 to the width - 1, the way the text maps
+   * list them. Every CHUNK_SIZE rows make the chunks of one cx, which lie
+   * next to each other in the file: they are built and written as soon as
+   * the last of their rows is in. Only that band of rows is ever in memory,
+   * CHUNK_SIZE bytes per cell of height, so a world larger than memory can
+   * be baked from anything that makes it row by row. The file is written
+   * aside and the header goes last, with the spawn, when close() finds every
+   * row written; only then does it replace the file at its path.
+   */
+  class ChunkWriter
+  {
+  public:
+    ChunkWriter();
+    ~ChunkWriter();
+
+    bool open(const std::string &path, int width, int height);
+    void writeRow(const Uint8 *values);
+    bool close(double spawnX, double spawnY, double spawnDirX, double spawnDirY);
+
+  private:
+    ChunkWriter(const ChunkWriter &);
+    ChunkWriter &operator=(const ChunkWriter &);
+
+    void writeBand();
+
+    std::ofstream out;
+    std::string path;
+    ChunksHeader head;
+    int mapWidth, mapHeight;
+    int rows;                /* Rows written so far */
+    std::vector<Uint8> band; /* Rows of the band being filled, row x at (x % CHUNK_SIZE) * height */
+  };
+}
+
+#endif // __THE_MAZE_CHUNKED_WORLD_H__
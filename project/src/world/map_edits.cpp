@@ -0,0 +1,46 @@
+#include "map_edits.hpp"
+
+namespace maze
+{
+  /**
+   * MapEdits - nothing queued, an empty dirty rectangle
+   */
+  MapEdits::MapEdits()
+  {
+    region.x0 = region.y0 = 0;
+    region.x1 = region.y1 = -1;
+  }
+
+  /**
+   * set - queue a change of a cell for the next apply()
+   * @x: cell x
+   * @y: cell y
+   * @value: 0 for empty, the texture slot + 1 for a wall
+   * Return: void
+   */
+  void MapEdits::set(int x, int y, Uint8 value)
+  {
+    MapChange change = {x, y, value, 0};
+    pending.push_back(change);
+  }
+
+  /**
+   * grow - extend the dirty rectangle to a cell
+   * @x: cell x
+   * @y: cell y
+   * Return: void
+   */
+  void MapEdits::grow(int x, int y)
+  {
+    if (region.x0 > region.x1)
+    {
+      region.x0 = region.x1 = x;
+      region.y0 = region.y1 = y;
+      return;
+    }
+    region.x0 = x < region.x0 ? x : region.x0;
+    region.y0 = y < region.y0 ? y : region.y0;
+    region.x1 = x > region.x1 ? x : region.x1;
+    region.y1 = y > region.y1 ? y : region.y1;
+  }
+}
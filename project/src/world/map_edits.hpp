@@ -0,0 +1,102 @@
+/**
+ * @file map_edits.hpp
+ * @brief Changes to the map queued during a frame and applied together.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_MAP_EDITS_H__
+#define __THE_MAZE_MAP_EDITS_H__
+
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+
+namespace maze
+{
+  /**
+   * One cell that changed, with what it was before.
+   */
+  struct MapChange
+  {
+    int x, y;
+    Uint8 value;    /* 0 for empty, the texture slot + 1 for a wall */
+    Uint8 previous; /* The value it replaced */
+  };
+
+  /**
+   * A rectangle of cells, both corners included, empty when x0 > x1.
+   */
+  struct MapRect
+  {
+    int x0, y0, x1, y1;
+  };
+
+  /**
+   * MapEdits - doors, moving walls and broken walls, batched per frame.
+   *
+   * Game code queues cell changes with set() at any time; apply() makes them
+   * all at once, before the frame is drawn, and hands back the cells that
+   * really changed along with the dirty rectangle around them. Whatever is
+   * derived from the map is then updated from that list only:
+   *   - the occupancy pyramid, which collisions and rays read, by the map's
+   *     own set(): a word of each layer per cell
+   *   - the lightmap, through Lightmap::cellChanged(): the cells the lights
+   *     around the change can reach
+   * so a door costs the same on any size of map. The minimap reads the map
+   * as it draws, it needs nothing.
+   */
+  class MapEdits
+  {
+  public:
+    MapEdits();
+
+    void set(int x, int y, Uint8 value);
+    template <class Map>
+    const std::vector<MapChange> &apply(Map &map);
+
+    int pendingCount() const { return int(pending.size()); }
+    const std::vector<MapChange> &changes() const { return applied; }
+    const MapRect &dirty() const { return region; }
+
+  private:
+    void grow(int x, int y);
+
+    std::vector<MapChange> pending; /* Queued since the last apply(), in order */
+    std::vector<MapChange> applied; /* Made by the last apply() */
+    MapRect region;                 /* Around the applied ones */
+  };
+
+  /**
+   * apply - make the queued changes, in the order they were queued
+   * @map: the cells, a WorldMap or a ChunkedWorld: anything with inside(),
+   *       at() and set() for a cell
+   *
+   * Changes outside the map, or to the value a cell already has, are
+   * dropped.
+   * Return: the changes made, valid until the next apply()
+   */
+  template <class Map>
+  const std::vector<MapChange> &MapEdits::apply(Map &map)
+  {
+    applied.clear();
+    region.x0 = region.y0 = 0;
+    region.x1 = region.y1 = -1;
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+      MapChange change = pending[i];
+      if (!map.inside(change.x, change.y))
+        continue;
+      change.previous = map.at(change.x, change.y);
+      if (change.previous == change.value)
+        continue;
+      map.set(change.x, change.y, change.value);
+      applied.push_back(change);
+      grow(change.x, change.y);
+    }
+    pending.clear();
+    return applied;
+  }
+}
+
+#endif // __THE_MAZE_MAP_EDITS_H__
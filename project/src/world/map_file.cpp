@@ -0,0 +1,162 @@
+#include "map_file.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace maze
+{
+  /**
+   * section - whether a section of a map file is where it can be used
+   * @offset: its offset
+   * @bytes: its size
+   * @end: where the section before it ends, set to where this one ends
+   * @size: file size
+   * Return: true if it is aligned, after the one before and inside the file
+   */
+  static bool section(Uint64 offset, Uint64 bytes, Uint64 &end, size_t size)
+  {
+    if (offset % MAP_ALIGN != 0 || offset < end || offset > size || bytes > size - offset)
+      return false;
+    end = offset + bytes;
+    return true;
+  }
+
+  /**
+   * align - round an offset up to the section alignment
+   * @offset: the offset
+   * Return: the aligned offset
+   */
+  static Uint64 align(Uint64 offset)
+  {
+    return (offset + MAP_ALIGN - 1) / MAP_ALIGN * MAP_ALIGN;
+  }
+
+  MapFile::MapFile() : data(0), size(0), world(0)
+  {
+  }
+
+  MapFile::~MapFile()
+  {
+    close();
+  }
+
+  /**
+   * open - map a map file and check its structure
+   * @path: the map
+   * Return: true if the map is usable, false if it is missing or invalid
+   */
+  bool MapFile::open(const std::string &path)
+  {
+    close();
+    /* Rays jump around the map, reading ahead in order wouldn't help */
+    if (!file.open(path, QuickCG::MappedFile::ACCESS_RANDOM, true) || file.size() < sizeof(MapHeader))
+    {
+      close();
+      return false;
+    }
+    data = file.writableData();
+    size = file.size();
+
+    const MapHeader &h = header();
+    if (memcmp(h.magic, MAP_MAGIC, 8) != 0 || h.version != MAP_VERSION || h.byteOrder != MAP_BYTE_ORDER ||
+        h.fileSize != size || h.width < 1 || h.width > MAP_MAX_SIZE || h.height < 1 || h.height > MAP_MAX_SIZE ||
+        h.layout > WorldMap::LAYOUT_LINEAR)
+    {
+      close();
+      return false;
+    }
+    int width = int(h.width), height = int(h.height);
+    WorldMap::Layout layout = WorldMap::Layout(h.layout);
+    Uint64 end = sizeof(MapHeader);
+    if (!section(h.cellsOffset, WorldMap::cellCount(width, height, layout), end, size) ||
+        !section(h.blocksOffset, OccupancyGrid::blockCount(width, height) * sizeof(Uint64), end, size) ||
+        !section(h.supersOffset, OccupancyGrid::superCount(width, height) * sizeof(Uint64), end, size) ||
+        h.spriteCount > size / sizeof(MapSprite) ||
+        !section(h.spritesOffset, Uint64(h.spriteCount) * sizeof(MapSprite), end, size))
+    {
+      close();
+      return false;
+    }
+
+    /* Written the wrong way round, these would put the player or sprites outside the map */
+    bool valid = h.spawnX >= 0 && h.spawnX < width && h.spawnY >= 0 && h.spawnY < height &&
+                 (h.spawnDirX != 0 || h.spawnDirY != 0);
+    for (Uint32 i = 0; valid && i < h.spriteCount; i++)
+      valid = sprites()[i].x >= 0 && sprites()[i].x < width && sprites()[i].y >= 0 && sprites()[i].y < height;
+    if (!valid)
+    {
+      close();
+      return false;
+    }
+
+    world = new WorldMap(width, height, layout, data + h.cellsOffset, (Uint64 *)(data + h.blocksOffset),
+                         (Uint64 *)(data + h.supersOffset));
+    return true;
+  }
+
+  /**
+   * close - unmap the map, its world is gone after this
+   * Return: void
+   */
+  void MapFile::close()
+  {
+    delete world;
+    world = 0;
+    file.close();
+    data = 0;
+    size = 0;
+  }
+
+  /**
+   * save - write a map file
+   * @path: the file
+   * @map: the cells, stored in their layout with their occupancy
+   * @sprites: the sprites
+   * @spriteCount: how many there are
+   * @spawnX: where the player starts, x
+   * @spawnY: where the player starts, y
+   * @spawnDirX: where the player looks, x
+   * @spawnDirY: where the player looks, y
+   * Return: true if the file was written
+   */
+  bool MapFile::save(const std::string &path, const WorldMap &map, const MapSprite *sprites, int spriteCount,
+                     double spawnX, double spawnY, double spawnDirX, double spawnDirY)
+  {
+    size_t cellBytes = WorldMap::cellCount(map.width(), map.height(), map.cellLayout());
+    size_t blockBytes = OccupancyGrid::blockCount(map.width(), map.height()) * sizeof(Uint64);
+    size_t superBytes = OccupancyGrid::superCount(map.width(), map.height()) * sizeof(Uint64);
+    size_t spriteBytes = size_t(spriteCount) * sizeof(MapSprite);
+
+    MapHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAP_MAGIC, 8);
+    h.version = MAP_VERSION;
+    h.byteOrder = MAP_BYTE_ORDER;
+    h.width = Uint32(map.width());
+    h.height = Uint32(map.height());
+    h.layout = Uint32(map.cellLayout());
+    h.spriteCount = Uint32(spriteCount);
+    h.spawnX = spawnX;
+    h.spawnY = spawnY;
+    h.spawnDirX = spawnDirX;
+    h.spawnDirY = spawnDirY;
+    h.cellsOffset = align(sizeof(MapHeader));
+    h.blocksOffset = align(h.cellsOffset + cellBytes);
+    h.supersOffset = align(h.blocksOffset + blockBytes);
+    h.spritesOffset = align(h.supersOffset + superBytes);
+    h.fileSize = h.spritesOffset + spriteBytes;
+
+    std::vector<unsigned char> bytes(size_t(h.fileSize), 0);
+    memcpy(&bytes[0], &h, sizeof(h));
+    memcpy(&bytes[size_t(h.cellsOffset)], map.cellData(), cellBytes);
+    memcpy(&bytes[size_t(h.blocksOffset)], map.grid().blockData(), blockBytes);
+    memcpy(&bytes[size_t(h.supersOffset)], map.grid().superData(), superBytes);
+    if (spriteCount > 0)
+      memcpy(&bytes[size_t(h.spritesOffset)], sprites, spriteBytes);
+
+    std::ofstream out(path.c_str(), std::ios::out | std::ios::binary);
+    out.write((const char *)&bytes[0], std::streamsize(bytes.size()));
+    return out.good();
+  }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file map_file.hpp
+ * @brief Binary map file: the layers of a WorldMap in one mappable file.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_MAP_FILE_H__
+#define __THE_MAZE_MAP_FILE_H__
+
+#include <string>
+
+#include "../../../lib/quickcg.h"
+#include "world_map.hpp"
+
+namespace maze
+{
+  /*
+   * Map file layout, all numbers in the byte order of the machine that baked
+   * it (checked through byteOrder):
+   *   MapHeader
+   *   cells                     WorldMap::cellCount() bytes, in the header's layout
+   *   occupancy blocks          OccupancyGrid::blockCount() Uint64
+   *   occupancy super-blocks    OccupancyGrid::superCount() Uint64
+   *   MapSprite[spriteCount]
+   * Every section is MAP_ALIGN aligned. tools/mapbake.cpp writes it through
+   * MapFile::save, MapFile reads it.
+   */
+  static const char MAP_MAGIC[8] = {'M', 'A', 'Z', 'E', 'M', 'A', 'P', '1'};
+  static const Uint32 MAP_VERSION = 1;
+  static const Uint32 MAP_BYTE_ORDER = 0x01020304;
+  static const Uint32 MAP_ALIGN = 64;
+  static const Uint32 MAP_MAX_SIZE = 1 << 16; /* Cells along each axis */
+
+  struct MapHeader
+  {
+    char magic[8];
+    Uint32 version;
+    Uint32 byteOrder;
+    Uint32 width, height;          /* In cells */
+    Uint32 layout;                 /* WorldMap::Layout of the cells */
+    Uint32 spriteCount;
+    double spawnX, spawnY;         /* Where the player starts */
+    double spawnDirX, spawnDirY;   /* Where the player looks */
+    Uint64 cellsOffset;            /* Of each section from the start of the file */
+    Uint64 blocksOffset;
+    Uint64 supersOffset;
+    Uint64 spritesOffset;
+    Uint64 fileSize;
+  };
+
+  struct MapSprite
+  {
+    double x, y;
+    Uint32 texture; /* Texture slot */
+    Uint32 reserved;
+  };
+
+  /**
+   * MapFile - a map file, mapped copy-on-write.
+   *
+   * The world it hands out works on the mapping in place: nothing is parsed
+   * or copied at load, pages come in as rays first cross them, and
+   * processes running the same map share every page nobody changed. Changes
+   * to the world stay in this process and never reach the file.
+   *
+   * open() checks the structure once, so the layers can be trusted to be
+   * where the header says. Cell values aren't checked, that would touch
+   * every page: the game checks texture slots where it uses them.
+   */
+  class MapFile
+  {
+  public:
+    MapFile();
+    ~MapFile();
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return world != 0; }
+
+    WorldMap &map() { return *world; }
+    const MapHeader &header() const { return *(const MapHeader *)data; }
+    const MapSprite *sprites() const { return (const MapSprite *)(data + header().spritesOffset); }
+    int spriteCount() const { return int(header().spriteCount); }
+
+    static bool save(const std::string &path, const WorldMap &map, const MapSprite *sprites, int spriteCount,
+                     double spawnX, double spawnY, double spawnDirX, double spawnDirY);
+
+  private:
+    MapFile(const MapFile &);
+    MapFile &operator=(const MapFile &);
+
+    QuickCG::MappedFile file;
+    unsigned char *data; /* The mapping, NULL when closed */
+    size_t size;
+    WorldMap *world;     /* Over the mapping */
+  };
+}
+
+#endif // __THE_MAZE_MAP_FILE_H__
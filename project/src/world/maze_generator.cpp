@@ -0,0 +1,398 @@
+#include "maze_generator.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace maze
+{
+  static const int dx[4] = {1, -1, 0, 0}; /* Directions, d ^ 1 is the opposite of d */
+  static const int dy[4] = {0, 0, 1, -1};
+  static const int SECTOR = 16;           /* Cells of a room and its walls, along each axis */
+  static const int CAVE_STEPS = 4;        /* Smoothing passes of the caves */
+
+  /**
+   * MazeGenerator - a generator
+   * @seed: any number, the same seed gives the same levels
+   */
+  MazeGenerator::MazeGenerator(Uint64 seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1), coins(0)
+  {
+    /* xorshift must not start at 0, and close seeds should give unrelated levels */
+    if (!state)
+      state = 1;
+    for (int i = 0; i < 8; i++)
+      next();
+  }
+
+  /**
+   * parse - the algorithm of a name, as written in text maps
+   * @name: backtracker, eller, rooms or caves
+   * @algorithm: set to the algorithm
+   * Return: false for an unknown name
+   */
+  bool MazeGenerator::parse(const std::string &name, Algorithm &algorithm)
+  {
+    static const char *names[] = {"backtracker", "eller", "rooms", "caves"};
+    for (int i = 0; i < 4; i++)
+      if (name == names[i])
+      {
+        algorithm = Algorithm(i);
+        return true;
+      }
+    return false;
+  }
+
+  /**
+   * generate - replace every cell of a map with a new level
+   * @map: the map, at least 3x3
+   * @algorithm: how
+   * @wall: the value of the walls, the texture slot + 1
+   *
+   * The algorithms write the cells only, the occupancy is rebuilt once at
+   * the end.
+   * Return: void
+   */
+  void MazeGenerator::generate(WorldMap &map, Algorithm algorithm, Uint8 wall)
+  {
+    map.fill(wall);
+    if (map.width() < 3 || map.height() < 3)
+      return;
+    if (algorithm == BACKTRACKER)
+      backtracker(map, wall);
+    else if (algorithm == ELLER)
+      eller(map, wall);
+    else if (algorithm == ROOMS)
+      rooms(map);
+    else
+      caves(map);
+    map.sync();
+  }
+
+  /**
+   * backtracker - walk to random unvisited cells, back up from dead ends
+   * @map: the map, all walls
+   * @wall: the value of the walls
+   *
+   * Iterative: instead of a stack, every cell keeps the direction it was
+   * reached from, and backing up follows those. The cells have a ring of
+   * visited ones around them, so neighbors need no bounds checks. The walk
+   * only touches that byte per maze cell, a quarter of the map's cells; the
+   * directions are the passages, expanded into the map a row at a time at
+   * the end.
+   * Return: void
+   */
+  void MazeGenerator::backtracker(WorldMap &map, Uint8 wall)
+  {
+    int wide = (map.width() - 1) / 2, high = (map.height() - 1) / 2, stride = high + 2;
+    /* 0 for unvisited, 1 + the direction back for the others, 5 for the first and the ring */
+    std::vector<Uint8> from(size_t(wide + 2) * stride, 5);
+    for (int i = 1; i <= wide; i++)
+      memset(&from[size_t(i) * stride + 1], 0, high);
+    const ptrdiff_t offset[4] = {stride, -stride, 1, -1};
+    /* For every set of unvisited neighbors and a number below 12, a multiple of 1 to 4, one of them fairly */
+    ptrdiff_t step[16][12];
+    Uint8 back[16][12];
+    for (int mask = 1; mask < 16; mask++)
+    {
+      int options[4], count = 0;
+      for (int d = 0; d < 4; d++)
+        if (mask >> d & 1)
+          options[count++] = d;
+      for (int k = 0; k < 12; k++)
+      {
+        step[mask][k] = offset[options[k % count]];
+        back[mask][k] = Uint8(1 + (options[k % count] ^ 1));
+      }
+    }
+    int i = int(below(wide)), j = int(below(high));
+    size_t cell = size_t(i + 1) * stride + j + 1;
+    from[cell] = 5;
+    for (;;)
+    {
+      /* The number is drawn before the neighbors are read, to keep it off the chain from one cell to the next */
+      int k = int(below(12));
+      const Uint8 *c = &from[cell];
+      int mask = (c[stride] == 0) | (c[-stride] == 0) << 1 | (c[1] == 0) << 2 | (c[-1] == 0) << 3;
+      /* Back up to the last cell with a way on, without drawing numbers */
+      while (!mask)
+      {
+        int d = from[cell] - 1;
+        if (d == 4)
+          break;
+        cell += offset[d];
+        c = &from[cell];
+        mask = (c[stride] == 0) | (c[-stride] == 0) << 1 | (c[1] == 0) << 2 | (c[-1] == 0) << 3;
+      }
+      if (!mask)
+        break;
+      cell += step[mask][k];
+      from[cell] = back[mask][k];
+    }
+
+    /* A cell opens the wall on its way back, the ring and the first cell have none; no branches, the maze is random */
+    std::vector<Uint8> cells(map.height(), wall), between(map.height(), wall);
+    for (i = 0; i < wide; i++)
+    {
+      const Uint8 *row = &from[size_t(i + 1) * stride + 1], *next = row + stride;
+      for (j = 0; j < high; j++)
+      {
+        cells[2 * j + 1] = 0;
+        cells[2 * j + 2] = Uint8(wall * !((row[j] == 1 + 2) | (row[j + 1] == 1 + 3)));
+        between[2 * j + 1] = Uint8(wall * !((row[j] == 1 + 0) | (next[j] == 1 + 1)));
+      }
+      map.writeRow(2 * i + 1, &cells[0]);
+      map.writeRow(2 * i + 2, &between[0]);
+    }
+  }
+
+  /**
+   * eller - Kruskal's merging of sets of connected cells, a row at a time
+   * @map: the map, all walls
+   * @wall: the value of the walls
+   *
+   * Only the sets of the current row are kept, as circular lists ordered
+   * along the row: the sets of a row never interleave, so two neighbors
+   * are in the same set exactly when one follows the other in its list.
+   * Joins and splits are O(1), memory is two ints per cell of a row. The
+   * coin flips are random, so they pick values instead of branching: a
+   * join or split that doesn't happen writes back what the lists hold.
+   * Every row of cells, and the row of walls after it, is built aside and
+   * written to the map whole.
+   * Return: void
+   */
+  void MazeGenerator::eller(WorldMap &map, Uint8 wall)
+  {
+    int wide = (map.width() - 1) / 2, high = (map.height() - 1) / 2;
+    std::vector<int> left(high), right(high);
+    std::vector<Uint8> cells(map.height(), wall), between(map.height(), wall);
+    for (int j = 0; j < high; j++)
+      left[j] = right[j] = j;
+    for (int i = 0; i < wide; i++)
+    {
+      bool last = i == wide - 1;
+      for (int j = 0; j < high; j++)
+      {
+        cells[2 * j + 1] = 0;
+        /* Join the next cell's set, always on the last row so that everything is connected */
+        if (j + 1 < high)
+        {
+          int join = -int((right[j] != j + 1) & (last | coin()));
+          int a = right[j], b = left[j + 1];
+          left[a] = (b & join) | (left[a] & ~join);
+          right[b] = (a & join) | (right[b] & ~join);
+          right[j] = ((j + 1) & join) | (right[j] & ~join);
+          left[j + 1] = (j & join) | (left[j + 1] & ~join);
+          cells[2 * j + 2] = Uint8(wall & ~join);
+        }
+        if (last)
+          continue;
+        /* Down to the next row, unless another cell of the set still can */
+        int split = -int((left[j] != j) & coin());
+        int a = left[j], b = right[j];
+        left[b] = (a & split) | (left[b] & ~split);
+        right[a] = (b & split) | (right[a] & ~split);
+        left[j] = (j & split) | (left[j] & ~split);
+        right[j] = (j & split) | (right[j] & ~split);
+        between[2 * j + 1] = Uint8(wall & split);
+      }
+      map.writeRow(2 * i + 1, &cells[0]);
+      if (!last)
+        map.writeRow(2 * i + 2, &between[0]);
+    }
+  }
+
+  /**
+   * rooms - a room of random size in every sector, with corridors between
+   * neighbors
+   * @map: the map, all walls
+   *
+   * Sectors along y are always joined, along x only sometimes but always
+   * at the first of a row, which keeps everything connected with a few
+   * loops.
+   * Return: void
+   */
+  void MazeGenerator::rooms(WorldMap &map)
+  {
+    int sector = SECTOR;
+    if (map.width() < sector || map.height() < sector)
+      sector = map.width() < map.height() ? map.width() : map.height();
+    int wide = map.width() / sector, high = map.height() / sector;
+    int minSize = sector >= 8 ? 4 : 1, span = sector - 2 - minSize + 1;
+    std::vector<int> centerX(high), centerY(high); /* Of the rooms of the previous row of sectors */
+    for (int sx = 0; sx < wide; sx++)
+      for (int sy = 0; sy < high; sy++)
+      {
+        int w = minSize + int(below(span)), h = minSize + int(below(span));
+        int x0 = sx * sector + 1 + int(below(sector - 1 - w)), y0 = sy * sector + 1 + int(below(sector - 1 - h));
+        for (int x = x0; x < x0 + w; x++)
+          for (int y = y0; y < y0 + h; y++)
+            map.write(x, y, 0);
+
+        int cx = x0 + w / 2, cy = y0 + h / 2;
+        /* L-shaped corridors to the room before along y, and along x */
+        if (sy > 0)
+        {
+          for (int y = cy; y > centerY[sy - 1]; y--)
+            map.write(cx, y, 0);
+          for (int x = cx < centerX[sy - 1] ? cx : centerX[sy - 1]; x <= (cx < centerX[sy - 1] ? centerX[sy - 1] : cx); x++)
+            map.write(x, centerY[sy - 1], 0);
+        }
+        if (sx > 0 && (sy == 0 || below(3) == 0))
+        {
+          for (int x = cx; x > centerX[sy]; x--)
+            map.write(x, cy, 0);
+          for (int y = cy < centerY[sy] ? cy : centerY[sy]; y <= (cy < centerY[sy] ? centerY[sy] : cy); y++)
+            map.write(centerX[sy], y, 0);
+        }
+        centerX[sy] = cx;
+        centerY[sy] = cy;
+      }
+  }
+
+  /**
+   * border - walls all around a cave bitmap, and past its edge
+   * @bits: rows of words, a bit per cell along y
+   * @width: rows
+   * @height: cells of a row
+   * Return: void
+   */
+  static void border(std::vector<Uint64> &bits, int width, int height)
+  {
+    int words = (height + 63) / 64;
+    for (int k = 0; k < words; k++)
+    {
+      bits[k] = ~Uint64(0);
+      bits[size_t(width - 1) * words + k] = ~Uint64(0);
+    }
+    Uint64 pad = (height & 63) ? ~Uint64(0) << (height & 63) : 0;
+    for (int x = 0; x < width; x++)
+    {
+      Uint64 *row = &bits[size_t(x) * words];
+      row[0] |= 1;
+      row[(height - 1) >> 6] |= Uint64(1) << ((height - 1) & 63);
+      row[words - 1] |= pad;
+    }
+  }
+
+  /**
+   * caves - random noise smoothed into caves
+   * @map: the map, all walls
+   *
+   * 7 cells in 16 start as walls, then every pass makes a cell a wall when
+   * 5 or more of the 9 around it (itself included) are. The cells are bits,
+   * 64 of a row at once: a pass counts the 9 neighbors of 64 cells with a
+   * few full adders of whole words.
+   * Return: void
+   */
+  void MazeGenerator::caves(WorldMap &map)
+  {
+    int width = map.width(), height = map.height(), words = (height + 63) / 64;
+    std::vector<Uint64> bits(size_t(width) * words), smoothed(bits.size());
+    for (size_t k = 0; k < bits.size(); k++)
+    {
+      Uint64 r0 = next(), r1 = next(), r2 = next(), r3 = next();
+      bits[k] = ~r3 & ~(r2 & r1 & r0);
+    }
+    border(bits, width, height);
+
+    for (int pass = 0; pass < CAVE_STEPS; pass++)
+    {
+      for (int x = 1; x < width - 1; x++)
+        for (int k = 0; k < words; k++)
+        {
+          Uint64 s[3], c[3];
+          for (int r = 0; r < 3; r++)
+          {
+            const Uint64 *row = &bits[size_t(x - 1 + r) * words];
+            Uint64 w = row[k];
+            Uint64 up = (w << 1) | (k > 0 ? row[k - 1] >> 63 : 1);
+            Uint64 down = (w >> 1) | ((k + 1 < words ? row[k + 1] : 1) << 63);
+            s[r] = up ^ w ^ down;
+            c[r] = (up & w) | (down & (up ^ w));
+          }
+          /* The count is s1 + 2 * (c1 + s2) + 4 * c2 */
+          Uint64 s1 = s[0] ^ s[1] ^ s[2], c1 = (s[0] & s[1]) | (s[2] & (s[0] ^ s[1]));
+          Uint64 s2 = c[0] ^ c[1] ^ c[2], c2 = (c[0] & c[1]) | (c[2] & (c[0] ^ c[1]));
+          Uint64 t0 = c1 ^ s2, t1 = c1 & s2;
+          smoothed[size_t(x) * words + k] = (t1 & c2) | ((t1 ^ c2) & (t0 | s1));
+        }
+      border(smoothed, width, height);
+      bits.swap(smoothed);
+    }
+
+    for (int x = 1; x < width - 1; x++)
+      for (int k = 0; k < words; k++)
+        for (Uint64 open = ~bits[size_t(x) * words + k]; open; open &= open - 1)
+          map.write(x, k * 64 + __builtin_ctzll(open), 0);
+  }
+
+  /**
+   * spawn - a random empty cell to start in, looking along an open side
+   * @map: the map
+   * @x: set to the start x, the cell's center
+   * @y: set to the start y
+   * @dirX: set to the heading x, along an axis
+   * @dirY: set to the heading y
+   * Return: void, the center of the map if it is all walls
+   */
+  void MazeGenerator::spawn(const WorldMap &map, double &x, double &y, double &dirX, double &dirY)
+  {
+    int cellX = map.width() / 2, cellY = map.height() / 2;
+    bool found = false;
+    for (int i = 0; i < 4096 && !found; i++)
+    {
+      int tx = int(below(map.width())), ty = int(below(map.height()));
+      if (map.walkable(tx, ty))
+      {
+        cellX = tx;
+        cellY = ty;
+        found = true;
+      }
+    }
+    for (int tx = 0; tx < map.width() && !found; tx++)
+      for (int ty = 0; ty < map.height() && !found; ty++)
+        if (map.walkable(tx, ty))
+        {
+          cellX = tx;
+          cellY = ty;
+          found = true;
+        }
+    x = cellX + 0.5;
+    y = cellY + 0.5;
+    dirX = 1;
+    dirY = 0;
+    int first = int(below(4));
+    for (int i = 0; i < 4; i++)
+    {
+      int d = (first + i) & 3;
+      if (map.walkable(cellX + dx[d], cellY + dy[d]))
+      {
+        dirX = dx[d];
+        dirY = dy[d];
+        break;
+      }
+    }
+  }
+
+  /**
+   * scatter - add sprites on random empty cells
+   * @map: the map
+   * @count: how many
+   * @texture: their texture slot
+   * @sprites: where they are added, at the centers of their cells
+   * Return: void, fewer are added if empty cells are too hard to find
+   */
+  void MazeGenerator::scatter(const WorldMap &map, int count, Uint32 texture, std::vector<MapSprite> &sprites)
+  {
+    for (int i = 0; i < count; i++)
+      for (int tries = 0; tries < 64; tries++)
+      {
+        int x = int(below(map.width())), y = int(below(map.height()));
+        if (map.walkable(x, y))
+        {
+          MapSprite sprite = {x + 0.5, y + 0.5, texture, 0};
+          sprites.push_back(sprite);
+          break;
+        }
+      }
+  }
+}
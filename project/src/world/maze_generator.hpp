@@ -0,0 +1,98 @@
+/**
+ * @file maze_generator.hpp
+ * @brief Seeded procedural levels, generated straight into a WorldMap.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_MAZE_GENERATOR_H__
+#define __THE_MAZE_MAZE_GENERATOR_H__
+
+#include <string>
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+#include "map_file.hpp"
+#include "world_map.hpp"
+
+namespace maze
+{
+  /**
+   * MazeGenerator - levels from a seed.
+   *
+   * The same seed, size and algorithm always give the same level, on any
+   * machine: the generator has its own random numbers, nothing comes from
+   * the standard library's. Every algorithm is iterative and works in one
+   * pass or a few; the mazes carve a byte per maze cell or a row at a time
+   * and write the map a row at a time, in the order of its cells, and the
+   * occupancy is rebuilt once at the end. Besides the map, the memory taken
+   * is a byte per maze cell at most.
+   *
+   * Only mapbake links it: levels are generated offline, into map files.
+   *
+   * Mazes put their cells on odd coordinates, with walls between them that
+   * are carved into passages. The border is always a wall.
+   */
+  class MazeGenerator
+  {
+  public:
+    enum Algorithm
+    {
+      BACKTRACKER, /* Recursive backtracker: long winding corridors, few dead ends */
+      ELLER,       /* Kruskal's set merging, a row at a time: short corridors, many branches */
+      ROOMS,       /* A room per sector, joined by corridors, with loops */
+      CAVES        /* Cellular automaton caves, open areas that may have closed pockets */
+    };
+
+    explicit MazeGenerator(Uint64 seed);
+
+    static bool parse(const std::string &name, Algorithm &algorithm);
+
+    void generate(WorldMap &map, Algorithm algorithm, Uint8 wall);
+    void spawn(const WorldMap &map, double &x, double &y, double &dirX, double &dirY);
+    void scatter(const WorldMap &map, int count, Uint32 texture, std::vector<MapSprite> &sprites);
+
+  private:
+    /**
+     * next - xorshift64*, the generator's random numbers
+     * Return: 64 random bits
+     */
+    Uint64 next()
+    {
+      state ^= state >> 12;
+      state ^= state << 25;
+      state ^= state >> 27;
+      return state * 0x2545F4914F6CDD1DULL;
+    }
+
+    /**
+     * below - a random number in [0, n), without division
+     * @n: the bound, at least 1
+     * Return: the number
+     */
+    Uint32 below(Uint32 n) { return Uint32((Uint64(Uint32(next() >> 32)) * n) >> 32); }
+
+    /**
+     * coin - one random bit, 64 of them per next()
+     * Return: true or false, as likely
+     */
+    bool coin()
+    {
+      if (coins < 2)
+        coins = next() | Uint64(1) << 63; /* The top bit marks when the word is used up */
+      bool heads = coins & 1;
+      coins >>= 1;
+      return heads;
+    }
+
+    void backtracker(WorldMap &map, Uint8 wall);
+    void eller(WorldMap &map, Uint8 wall);
+    void rooms(WorldMap &map);
+    void caves(WorldMap &map);
+
+    Uint64 state;
+    Uint64 coins; /* Bits left for coin(), above the top set one */
+  };
+}
+
+#endif // __THE_MAZE_MAZE_GENERATOR_H__
@@ -0,0 +1,102 @@
+#include "occupancy_grid.hpp"
+
+#include <algorithm>
+
+namespace maze
+{
+  /**
+   * OccupancyGrid - an empty pyramid for a map
+   * @mapWidth: map width
+   * @mapHeight: map height
+   */
+  OccupancyGrid::OccupancyGrid(int mapWidth, int mapHeight)
+      : mapWidth(mapWidth), mapHeight(mapHeight), blocksHigh((mapHeight + 7) / 8), supersHigh((mapHeight + 63) / 64),
+        owned(blockCount(mapWidth, mapHeight) + superCount(mapWidth, mapHeight))
+  {
+    blocks = &owned[0];
+    supers = blocks + blockCount(mapWidth, mapHeight);
+  }
+
+  /**
+   * OccupancyGrid - a pyramid over layers kept elsewhere
+   * @mapWidth: map width
+   * @mapHeight: map height
+   * @blocks: blockCount() words, already matching the map
+   * @supers: superCount() words, already matching the blocks
+   */
+  OccupancyGrid::OccupancyGrid(int mapWidth, int mapHeight, Uint64 *blocks, Uint64 *supers)
+      : mapWidth(mapWidth), mapHeight(mapHeight), blocksHigh((mapHeight + 7) / 8), supersHigh((mapHeight + 63) / 64),
+        blocks(blocks), supers(supers)
+  {
+  }
+
+  /**
+   * set - make a cell a wall or empty
+   * @x: cell x
+   * @y: cell y
+   * @wall: true for a wall
+   * Return: void
+   */
+  void OccupancyGrid::set(int x, int y, bool wall)
+  {
+    Uint64 &block = blocks[size_t(x >> 3) * blocksHigh + (y >> 3)];
+    Uint64 cellBit = Uint64(1) << (((x & 7) << 3) | (y & 7));
+    block = wall ? block | cellBit : block & ~cellBit;
+
+    Uint64 &super = supers[size_t(x >> 6) * supersHigh + (y >> 6)];
+    Uint64 blockBit = Uint64(1) << ((((x >> 3) & 7) << 3) | ((y >> 3) & 7));
+    super = block ? super | blockBit : super & ~blockBit;
+  }
+
+  /**
+   * setBlock - change the 64 cells of a block at once
+   * @bx: block x, x / 8 of its cells
+   * @by: block y
+   * @cells: bit (x & 7) * 8 + (y & 7) for a wall, bits past the edge of the
+   *         map are dropped
+   * Return: void
+   */
+  void OccupancyGrid::setBlock(int bx, int by, Uint64 cells)
+  {
+    if (bx * 8 + 8 > mapWidth || by * 8 + 8 > mapHeight)
+    {
+      /* Bits past the edge of the map stay clear, like set() leaves them */
+      Uint64 inside = 0;
+      for (int x = bx * 8; x < bx * 8 + 8 && x < mapWidth; x++)
+        for (int y = by * 8; y < by * 8 + 8 && y < mapHeight; y++)
+          inside |= Uint64(1) << (((x & 7) << 3) | (y & 7));
+      cells &= inside;
+    }
+    blocks[size_t(bx) * blocksHigh + by] = cells;
+    Uint64 &super = supers[size_t(bx >> 3) * supersHigh + (by >> 3)];
+    Uint64 blockBit = Uint64(1) << (((bx & 7) << 3) | (by & 7));
+    super = cells ? super | blockBit : super & ~blockBit;
+  }
+
+  /**
+   * fill - make every cell of the map a wall or empty
+   * @wall: true for walls
+   * Return: void
+   */
+  void OccupancyGrid::fill(bool wall)
+  {
+    std::fill(supers, supers + superCount(mapWidth, mapHeight), Uint64(0));
+    for (int bx = 0; bx < (mapWidth + 7) / 8; bx++)
+      for (int by = 0; by < blocksHigh; by++)
+        setBlock(bx, by, wall ? ~Uint64(0) : 0);
+  }
+
+  /**
+   * cast - follow a ray to the first wall, see castRay()
+   * @posX: start x, inside the map
+   * @posY: start y, inside the map
+   * @rayDirX: direction x, the distances are in units of its length
+   * @rayDirY: direction y
+   * @maxDistance: distance to give up at
+   * Return: the wall, if any
+   */
+  RayHit OccupancyGrid::cast(double posX, double posY, double rayDirX, double rayDirY, double maxDistance) const
+  {
+    return castRay(*this, posX, posY, rayDirX, rayDirY, maxDistance);
+  }
+}
@@ -0,0 +1,198 @@
+/**
+ * @file occupancy_grid.hpp
+ * @brief Occupancy pyramid of the map, for rays that skip empty space.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_OCCUPANCY_GRID_H__
+#define __THE_MAZE_OCCUPANCY_GRID_H__
+
+#include <cmath>
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+
+namespace maze
+{
+  /**
+   * Where a ray stopped, as the DDA of the wall pass leaves it.
+   */
+  struct RayHit
+  {
+    bool hit;         /* False past the distance or outside the map */
+    int mapX, mapY;   /* The wall cell */
+    int side;         /* 0 for an x-side, 1 for a y-side */
+    int stepX, stepY; /* Direction of the ray on each axis, +1 or -1 */
+    int steps;        /* Cells stepped and blocks skipped */
+  };
+
+  /**
+   * OccupancyGrid - a three level pyramid of where the walls are.
+   *
+   * Cells are bits, an 8x8 block of them is one 64-bit word, and a 64x64
+   * super-block is one word with a bit per block that has a wall. A ray
+   * crosses an empty block or super-block in one jump, and only steps cell
+   * by cell where there are walls: its cost follows what it passes, not how
+   * far it goes. The jumps take the steps the plain DDA would take, so the
+   * ray ends in the same cell on the same side. WorldMap keeps it as the
+   * occupancy layer of its cells.
+   *
+   * The layers are its own, or words somewhere else, such as a mapped map
+   * file, used in place.
+   */
+  class OccupancyGrid
+  {
+  public:
+    OccupancyGrid(int mapWidth, int mapHeight);
+    OccupancyGrid(int mapWidth, int mapHeight, Uint64 *blocks, Uint64 *supers);
+
+    static size_t blockCount(int mapWidth, int mapHeight) { return size_t((mapWidth + 7) / 8) * ((mapHeight + 7) / 8); }
+    static size_t superCount(int mapWidth, int mapHeight) { return size_t((mapWidth + 63) / 64) * ((mapHeight + 63) / 64); }
+
+    void set(int x, int y, bool wall);
+    void setBlock(int bx, int by, Uint64 cells);
+    void fill(bool wall);
+    RayHit cast(double posX, double posY, double rayDirX, double rayDirY, double maxDistance) const;
+
+    /**
+     * wall - whether a cell of the map is a wall
+     * @x: cell x, inside the map
+     * @y: cell y, inside the map
+     * Return: true for a wall
+     */
+    bool wall(int x, int y) const { return (blocks[size_t(x >> 3) * blocksHigh + (y >> 3)] >> (((x & 7) << 3) | (y & 7))) & 1; }
+    bool blockEmpty(int x, int y) const { return !blocks[size_t(x >> 3) * blocksHigh + (y >> 3)]; }
+    bool superEmpty(int x, int y) const { return !supers[size_t(x >> 6) * supersHigh + (y >> 6)]; }
+    bool inside(int x, int y) const { return x >= 0 && y >= 0 && x < mapWidth && y < mapHeight; }
+
+    const Uint64 *blockData() const { return blocks; }
+    const Uint64 *superData() const { return supers; }
+
+  private:
+    OccupancyGrid(const OccupancyGrid &);
+    OccupancyGrid &operator=(const OccupancyGrid &);
+
+    int mapWidth, mapHeight;
+    int blocksHigh, supersHigh; /* Blocks and super-blocks along y */
+    Uint64 *blocks;             /* Bit (x & 7) * 8 + (y & 7) of a block is a cell */
+    Uint64 *supers;             /* Bit (bx & 7) * 8 + (by & 7) of a super-block is a block */
+    std::vector<Uint64> owned;  /* Both layers, unless they live elsewhere */
+  };
+
+  /**
+   * castRay - follow a ray to the first wall
+   * @grid: the pyramid, anything with inside(), superEmpty(), blockEmpty()
+   *        and wall() for a cell
+   * @posX: start x, inside the map
+   * @posY: start y, inside the map
+   * @rayDirX: direction x, the distances are in units of its length
+   * @rayDirY: direction y
+   * @maxDistance: distance to give up at
+   *
+   * The wall pass' DDA, except that from a cell in an empty block or
+   * super-block, the steps up to its border are taken at once: all those
+   * along the axis it leaves through, and as many along the other as come
+   * before that. Border distances are computed, not accumulated, so the
+   * jumps land exactly where single steps would.
+   * Return: the wall, if any
+   */
+  template <class Grid>
+  RayHit castRay(Grid &grid, double posX, double posY, double rayDirX, double rayDirY, double maxDistance)
+  {
+    RayHit ray;
+    ray.hit = false;
+    ray.side = 0;
+    ray.steps = 0;
+
+    int mapX = int(posX), mapY = int(posY);
+    double deltaDistX = (rayDirX == 0) ? 1e30 : std::abs(1 / rayDirX);
+    double deltaDistY = (rayDirY == 0) ? 1e30 : std::abs(1 / rayDirY);
+    int stepX = rayDirX < 0 ? -1 : 1, stepY = rayDirY < 0 ? -1 : 1;
+    /* Distance to the n-th x border is firstX + n * deltaDistX: a jump and single steps get exactly the same ones */
+    double firstX = (rayDirX < 0 ? posX - mapX : mapX + 1.0 - posX) * deltaDistX;
+    double firstY = (rayDirY < 0 ? posY - mapY : mapY + 1.0 - posY) * deltaDistY;
+    int bordersX = 0, bordersY = 0;
+
+    for (;;)
+    {
+      int size = grid.superEmpty(mapX, mapY) ? 64 : grid.blockEmpty(mapX, mapY) ? 8 : 1;
+      if (size > 1)
+      {
+        /* Steps left inside the block on each axis, and when the ray leaves it */
+        int cornerX = mapX & ~(size - 1), cornerY = mapY & ~(size - 1);
+        int restX = stepX > 0 ? cornerX + size - 1 - mapX : mapX - cornerX;
+        int restY = stepY > 0 ? cornerY + size - 1 - mapY : mapY - cornerY;
+        double exitX = firstX + (bordersX + restX) * deltaDistX;
+        double exitY = firstY + (bordersY + restY) * deltaDistY;
+        int stepsX, stepsY;
+        if (exitX < exitY)
+        {
+          /* Leaves along x, after the y-steps not later than that: ties go to y */
+          if (exitX > maxDistance)
+            break;
+          stepsX = restX;
+          stepsY = int((exitX - (firstY + bordersY * deltaDistY)) / deltaDistY) + 1;
+          stepsY = stepsY < 0 ? 0 : stepsY > restY ? restY : stepsY;
+          while (stepsY > 0 && firstY + (bordersY + stepsY - 1) * deltaDistY > exitX)
+            stepsY--;
+          while (stepsY < restY && firstY + (bordersY + stepsY) * deltaDistY <= exitX)
+            stepsY++;
+        }
+        else
+        {
+          /* Leaves along y, after the x-steps strictly before that */
+          if (exitY > maxDistance)
+            break;
+          stepsY = restY;
+          stepsX = int(std::ceil((exitY - (firstX + bordersX * deltaDistX)) / deltaDistX));
+          stepsX = stepsX < 0 ? 0 : stepsX > restX ? restX : stepsX;
+          while (stepsX > 0 && firstX + (bordersX + stepsX - 1) * deltaDistX >= exitY)
+            stepsX--;
+          while (stepsX < restX && firstX + (bordersX + stepsX) * deltaDistX < exitY)
+            stepsX++;
+        }
+        mapX += stepsX * stepX;
+        bordersX += stepsX;
+        mapY += stepsY * stepY;
+        bordersY += stepsY;
+        ray.steps++;
+      }
+
+      /* One DDA step, out of the block if it was empty */
+      double sideDistX = firstX + bordersX * deltaDistX;
+      double sideDistY = firstY + bordersY * deltaDistY;
+      if (sideDistX < sideDistY)
+      {
+        if (sideDistX > maxDistance)
+          break;
+        bordersX++;
+        mapX += stepX;
+        ray.side = 0;
+      }
+      else
+      {
+        if (sideDistY > maxDistance)
+          break;
+        bordersY++;
+        mapY += stepY;
+        ray.side = 1;
+      }
+      ray.steps++;
+      if (!grid.inside(mapX, mapY))
+        break;
+      if (grid.wall(mapX, mapY))
+      {
+        ray.hit = true;
+        break;
+      }
+    }
+    ray.mapX = mapX;
+    ray.mapY = mapY;
+    ray.stepX = stepX;
+    ray.stepY = stepY;
+    return ray;
+  }
+}
+
+#endif // __THE_MAZE_OCCUPANCY_GRID_H__
@@ -0,0 +1,393 @@
+#include "visible_sets.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace maze
+{
+  static const double RAY_SPACING = 1.0; /* Cells between two neighboring rays at the maximum distance */
+  static const int EDGE_SAMPLES = 3;     /* Points rays start from along each edge of a border cell */
+  static const double INSET = 1e-3;      /* How far inside its cell a point on an edge is taken */
+  static const double STEP = 0.25;       /* Cells between the cross-sections a beam is followed by past its wall */
+
+  /**
+   * VisibleSets - set up the sets of a map, none baked yet
+   * @map: the map
+   * @maxDistance: how far the camera sees, in cells along a ray
+   */
+  VisibleSets::VisibleSets(const WorldMap &map, double maxDistance)
+      : map(map), maxDistance(maxDistance), regionsWide((map.width() + REGION - 1) >> REGION_SHIFT),
+        regionsHigh((map.height() + REGION - 1) >> REGION_SHIFT), reach(int(std::ceil(maxDistance / REGION)) + 1),
+        sets(size_t(regionsWide) * regionsHigh), dirty(sets.size(), true), seen(size_t(2 * reach + 1) * (2 * reach + 1))
+  {
+  }
+
+  /**
+   * cellChanged - mark the sets a change of a map cell can affect
+   * @x: cell x
+   * @y: cell y
+   *
+   * Only rays from regions within the maximum distance reach the cell.
+   * Return: void
+   */
+  void VisibleSets::cellChanged(int x, int y)
+  {
+    int r = int(std::ceil(maxDistance));
+    int rx0 = std::max(x - r, 0) >> REGION_SHIFT, rx1 = std::min(x + r, map.width() - 1) >> REGION_SHIFT;
+    int ry0 = std::max(y - r, 0) >> REGION_SHIFT, ry1 = std::min(y + r, map.height() - 1) >> REGION_SHIFT;
+    for (int rx = rx0; rx <= rx1; rx++)
+      for (int ry = ry0; ry <= ry1; ry++)
+        dirty[size_t(rx) * regionsHigh + ry] = true;
+  }
+
+  /**
+   * update - bake the waiting sets around the camera, nearest first
+   * @x: cell x of the camera
+   * @y: cell y of the camera
+   * @maxSets: bake at most that many, the others wait for the next call;
+   *           0 for all of them
+   *
+   * Only the camera's region and the AROUND rings of regions around it are
+   * looked at, so the sets the camera walks into are ready and the rest of
+   * the map costs nothing.
+   * Return: the number of sets baked
+   */
+  int VisibleSets::update(int x, int y, int maxSets)
+  {
+    if (!map.inside(x, y))
+      return 0;
+    int cx = x >> REGION_SHIFT, cy = y >> REGION_SHIFT, count = 0;
+    for (int ring = 0; ring <= AROUND; ring++)
+      for (int rx = cx - ring; rx <= cx + ring; rx++)
+        for (int ry = cy - ring; ry <= cy + ring; ry++)
+        {
+          /* The border of the ring only, the inside was done before */
+          if ((rx != cx - ring && rx != cx + ring && ry != cy - ring && ry != cy + ring) ||
+              rx < 0 || ry < 0 || rx >= regionsWide || ry >= regionsHigh || !dirty[size_t(rx) * regionsHigh + ry])
+            continue;
+          if (maxSets > 0 && count == maxSets)
+            return count;
+          bake(rx, ry);
+          dirty[size_t(rx) * regionsHigh + ry] = false;
+          count++;
+        }
+    return count;
+  }
+
+  /**
+   * bake - cast the rays leaving a region and keep the regions they cross
+   * @rx: region x
+   * @ry: region y
+   * Return: void
+   */
+  void VisibleSets::bake(int rx, int ry)
+  {
+    static const int normals[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    int directions = int(std::ceil(2 * M_PI * maxDistance / RAY_SPACING));
+    std::fill(seen.begin(), seen.end(), 0);
+    mark(rx, ry, rx, ry);
+
+    /* The beam of a ray: the lines from its edge no further than half the
+       distance between two points, nor than half the angle between two
+       directions, which is every line leaving the edge outwards */
+    Beam beam;
+    beam.offset = (1 - 2 * INSET) / (2 * (EDGE_SAMPLES - 1)) + 2 * INSET;
+    beam.slope = std::tan(M_PI / directions);
+    /* Rays this close to along the edge still have lines going outwards */
+    double outwards = -std::sin(M_PI / directions);
+
+    int x0 = rx * REGION, y0 = ry * REGION;
+    int x1 = std::min(x0 + REGION, map.width()) - 1, y1 = std::min(y0 + REGION, map.height()) - 1;
+    for (int side = 0; side < 4; side++)
+    {
+      int nx = normals[side][0], ny = normals[side][1];
+      /* Rays leaving the map see nothing */
+      if ((nx < 0 && rx == 0) || (nx > 0 && rx == regionsWide - 1) || (ny < 0 && ry == 0) || (ny > 0 && ry == regionsHigh - 1))
+        continue;
+      /* The empty cells along the side, a few points on their outer edge, every direction out of it */
+      int cells = nx ? y1 - y0 + 1 : x1 - x0 + 1;
+      for (int c = 0; c < cells; c++)
+      {
+        int x = nx < 0 ? x0 : nx > 0 ? x1 : x0 + c;
+        int y = ny < 0 ? y0 : ny > 0 ? y1 : y0 + c;
+        if (map.wall(x, y))
+          continue;
+        for (int k = 0; k < EDGE_SAMPLES; k++)
+        {
+          double along = INSET + (1 - 2 * INSET) * k / (EDGE_SAMPLES - 1);
+          double px = nx ? x + (nx < 0 ? INSET : 1 - INSET) : x + along;
+          double py = ny ? y + (ny < 0 ? INSET : 1 - INSET) : y + along;
+          for (int d = 0; d < directions; d++)
+          {
+            double dirX = std::cos(2 * M_PI * d / directions), dirY = std::sin(2 * M_PI * d / directions);
+            if (dirX * nx + dirY * ny > outwards)
+              trace(rx, ry, px, py, dirX, dirY, beam);
+          }
+        }
+      }
+    }
+
+    /* Keep the box around what was seen */
+    int bx0 = 2 * reach, by0 = 2 * reach, bx1 = 0, by1 = 0, size = 2 * reach + 1;
+    for (int i = 0; i < size; i++)
+      for (int j = 0; j < size; j++)
+        if (seen[i * size + j])
+        {
+          bx0 = std::min(bx0, i);
+          by0 = std::min(by0, j);
+          bx1 = std::max(bx1, i);
+          by1 = std::max(by1, j);
+        }
+    Set &set = sets[size_t(rx) * regionsHigh + ry];
+    set.x0 = rx - reach + bx0;
+    set.y0 = ry - reach + by0;
+    set.wide = bx1 - bx0 + 1;
+    set.high = by1 - by0 + 1;
+    set.bits.assign((size_t(set.wide) * set.high + 63) / 64, 0);
+    for (int i = bx0; i <= bx1; i++)
+      for (int j = by0; j <= by1; j++)
+        if (seen[i * size + j])
+        {
+          size_t bit = size_t(i - bx0) * set.high + (j - by0);
+          set.bits[bit >> 6] |= Uint64(1) << (bit & 63);
+        }
+  }
+
+  /**
+   * trace - mark the regions the beam of a ray can reach
+   * @rx: region the ray leaves, x
+   * @ry: region the ray leaves, y
+   * @x: start x, inside the map
+   * @y: start y, inside the map
+   * @dirX: direction x, of length 1
+   * @dirY: direction y
+   * @beam: the lines the ray stands for
+   *
+   * At a distance d along the ray, every line of the beam crosses the
+   * perpendicular of the ray within its width(d) on each side. Up to the
+   * wall the ray stops at, the regions the beam touches are the ones its two
+   * edges and its ends cross: a region is far wider than the beam, it can't
+   * fit in between. Past that wall, some lines may still go on,
+   * through a gap the ray missed, so the beam is followed a cross-section at
+   * a time until one is all walls, which none of its lines can get through.
+   * Return: void
+   */
+  void VisibleSets::trace(int rx, int ry, double x, double y, double dirX, double dirY, const Beam &beam)
+  {
+    RayHit hit = map.grid().cast(x, y, dirX, dirY, maxDistance);
+    double end = maxDistance;
+    if (hit.hit)
+      /* Where the ray enters the wall, as the wall pass computes it */
+      end = hit.side == 0 ? (hit.mapX - x + (1 - hit.stepX) / 2) / dirX : (hit.mapY - y + (1 - hit.stepY) / 2) / dirY;
+
+    double length = std::sqrt(1 + beam.slope * beam.slope), start = beam.width(0);
+    for (int side = -1; side <= 1; side += 2)
+    {
+      double edgeX = (dirX - side * beam.slope * dirY) / length, edgeY = (dirY + side * beam.slope * dirX) / length;
+      markLine(rx, ry, x - side * start * dirY, y + side * start * dirX, edgeX, edgeY, end * length);
+    }
+    markSlab(rx, ry, x, y, dirX, dirY, beam, 0, 0);
+
+    double last = maxDistance + beam.offset; /* The furthest a line within the distance of the edge gets */
+    for (double d = end; d < last;)
+    {
+      double next = std::min(d + STEP, last);
+      markSlab(rx, ry, x, y, dirX, dirY, beam, d, next);
+      if (walled(x + dirX * next, y + dirY * next, -dirY, dirX, beam.width(next)))
+        break;
+      d = next;
+    }
+  }
+
+  /**
+   * markLine - mark the regions a line crosses
+   * @rx: region of the set, x
+   * @ry: region of the set, y
+   * @x: start x, inside the map or not
+   * @y: start y
+   * @dirX: direction x, of length 1
+   * @dirY: direction y
+   * @end: length of the line
+   *
+   * The DDA of the wall pass, over regions instead of cells.
+   * Return: void
+   */
+  void VisibleSets::markLine(int rx, int ry, double x, double y, double dirX, double dirY, double end)
+  {
+    double posX = x / REGION, posY = y / REGION;
+    int mapX = int(std::floor(posX)), mapY = int(std::floor(posY));
+    double deltaDistX = (dirX == 0) ? 1e30 : std::abs(REGION / dirX);
+    double deltaDistY = (dirY == 0) ? 1e30 : std::abs(REGION / dirY);
+    int stepX = dirX < 0 ? -1 : 1, stepY = dirY < 0 ? -1 : 1;
+    double sideDistX = (dirX < 0 ? posX - mapX : mapX + 1.0 - posX) * deltaDistX;
+    double sideDistY = (dirY < 0 ? posY - mapY : mapY + 1.0 - posY) * deltaDistY;
+    for (;;)
+    {
+      mark(rx, ry, mapX, mapY);
+      if (sideDistX < sideDistY)
+      {
+        if (sideDistX > end)
+          break;
+        sideDistX += deltaDistX;
+        mapX += stepX;
+      }
+      else
+      {
+        if (sideDistY > end)
+          break;
+        sideDistY += deltaDistY;
+        mapY += stepY;
+      }
+    }
+  }
+
+  /**
+   * markSlab - mark the regions around the beam between two distances
+   * @rx: region of the set, x
+   * @ry: region of the set, y
+   * @x: start x of the ray
+   * @y: start y of the ray
+   * @dirX: direction x, of length 1
+   * @dirY: direction y
+   * @beam: the lines the ray stands for
+   * @from: first distance along the ray
+   * @to: last distance, from itself for a single cross-section
+   *
+   * Every region the box around the two cross-sections touches, a few at
+   * most.
+   * Return: void
+   */
+  void VisibleSets::markSlab(int rx, int ry, double x, double y, double dirX, double dirY, const Beam &beam,
+                             double from, double to)
+  {
+    /* The beam is widest at the far end, the box around that width holds both ends */
+    double w = beam.width(to), wideX = std::abs(dirY) * w, wideY = std::abs(dirX) * w;
+    double x0 = x + std::min(dirX * from, dirX * to) - wideX, x1 = x + std::max(dirX * from, dirX * to) + wideX;
+    double y0 = y + std::min(dirY * from, dirY * to) - wideY, y1 = y + std::max(dirY * from, dirY * to) + wideY;
+    for (int i = int(std::floor(x0 / REGION)); i <= int(std::floor(x1 / REGION)); i++)
+      for (int j = int(std::floor(y0 / REGION)); j <= int(std::floor(y1 / REGION)); j++)
+        mark(rx, ry, i, j);
+  }
+
+  /**
+   * walled - whether a cross-section of a beam is walls from end to end
+   * @x: its middle, x
+   * @y: its middle, y
+   * @alongX: its direction, x, of length 1
+   * @alongY: its direction, y
+   * @width: how far it goes on each side
+   *
+   * Every cell the segment touches is looked at, corners included, and the
+   * outside of the map counts as a wall.
+   * Return: true if all of them are walls
+   */
+  bool VisibleSets::walled(double x, double y, double alongX, double alongY, double width) const
+  {
+    double posX = x - alongX * width, posY = y - alongY * width;
+    int mapX = int(std::floor(posX)), mapY = int(std::floor(posY));
+    double deltaDistX = (alongX == 0) ? 1e30 : std::abs(1 / alongX);
+    double deltaDistY = (alongY == 0) ? 1e30 : std::abs(1 / alongY);
+    int stepX = alongX < 0 ? -1 : 1, stepY = alongY < 0 ? -1 : 1;
+    double sideDistX = (alongX < 0 ? posX - mapX : mapX + 1.0 - posX) * deltaDistX;
+    double sideDistY = (alongY < 0 ? posY - mapY : mapY + 1.0 - posY) * deltaDistY;
+    for (;;)
+    {
+      if (map.walkable(mapX, mapY))
+        return false;
+      double next = std::min(sideDistX, sideDistY);
+      if (next > 2 * width)
+        return true;
+      /* Through a corner, or close enough to one, the cells on both sides are touched too */
+      if (std::abs(sideDistX - sideDistY) < 1e-9 &&
+          (map.walkable(mapX + stepX, mapY) || map.walkable(mapX, mapY + stepY)))
+        return false;
+      if (sideDistX < sideDistY)
+      {
+        sideDistX += deltaDistX;
+        mapX += stepX;
+      }
+      else
+      {
+        sideDistY += deltaDistY;
+        mapY += stepY;
+      }
+    }
+  }
+
+  /**
+   * mark - note a region as seen by the set being baked
+   * @rx: region of the set, x
+   * @ry: region of the set, y
+   * @x: region seen, x
+   * @y: region seen, y
+   * Return: void
+   */
+  void VisibleSets::mark(int rx, int ry, int x, int y)
+  {
+    int i = x - rx + reach, j = y - ry + reach, size = 2 * reach + 1;
+    if (i >= 0 && j >= 0 && i < size && j < size && x >= 0 && y >= 0 && x < regionsWide && y < regionsHigh)
+      seen[i * size + j] = 1;
+  }
+
+  /**
+   * visible - whether a cell may be seen from another
+   * @fromX: cell x of the camera
+   * @fromY: cell y of the camera
+   * @toX: cell x looked at
+   * @toY: cell y looked at
+   * Return: false only if nothing in the region of the one can see the
+   * region of the other
+   */
+  bool VisibleSets::visible(int fromX, int fromY, int toX, int toY) const
+  {
+    return visibleArea(fromX, fromY, toX, toY, toX, toY);
+  }
+
+  /**
+   * visibleArea - whether any cell of a rectangle may be seen from a cell
+   * @fromX: cell x of the camera
+   * @fromY: cell y of the camera
+   * @x0: first cell x of the rectangle
+   * @y0: first cell y
+   * @x1: last cell x
+   * @y1: last cell y
+   * Return: false only if no region the rectangle touches can be seen,
+   * true outside the map or while the camera's set waits for its bake
+   */
+  bool VisibleSets::visibleArea(int fromX, int fromY, int x0, int y0, int x1, int y1) const
+  {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, map.width() - 1);
+    y1 = std::min(y1, map.height() - 1);
+    if (!map.inside(fromX, fromY) || x0 > x1 || y0 > y1)
+      return true;
+    size_t from = size_t(fromX >> REGION_SHIFT) * regionsHigh + (fromY >> REGION_SHIFT);
+    if (dirty[from])
+      return true;
+    const Set &set = sets[from];
+    for (int rx = x0 >> REGION_SHIFT; rx <= x1 >> REGION_SHIFT; rx++)
+      for (int ry = y0 >> REGION_SHIFT; ry <= y1 >> REGION_SHIFT; ry++)
+      {
+        int i = rx - set.x0, j = ry - set.y0;
+        if (i < 0 || j < 0 || i >= set.wide || j >= set.high)
+          continue;
+        size_t bit = size_t(i) * set.high + j;
+        if ((set.bits[bit >> 6] >> (bit & 63)) & 1)
+          return true;
+      }
+    return false;
+  }
+
+  /**
+   * byteCount - memory taken by the sets
+   * Return: the bytes
+   */
+  size_t VisibleSets::byteCount() const
+  {
+    size_t bytes = sets.size() * sizeof(Set);
+    for (size_t i = 0; i < sets.size(); i++)
+      bytes += sets[i].bits.size() * sizeof(Uint64);
+    return bytes;
+  }
+}
@@ -0,0 +1,92 @@
+/**
+ * @file visible_sets.hpp
+ * @brief Potentially visible sets: which parts of the map can see which.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_VISIBLE_SETS_H__
+#define __THE_MAZE_VISIBLE_SETS_H__
+
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+#include "world_map.hpp"
+
+namespace maze
+{
+  /**
+   * VisibleSets - for every region of the map, the regions that can be seen
+   * from somewhere in it.
+   *
+   * Regions are 8x8 cells, the blocks of the occupancy pyramid. A region's
+   * set is baked by casting rays from its border, since whatever is seen
+   * from inside is seen through it: from points along every edge of its
+   * empty border cells, in directions a cell apart at the maximum distance.
+   * Each ray stands for the beam of lines between it and its neighbors, and
+   * the regions that beam can reach are marked: up to the wall the ray stops
+   * at, then on through any gap until the whole width of the beam is walled.
+   * The beams cover every line out of the region, so a set holds every
+   * region seen from it, and some that are not.
+   *
+   * A set is a bitset over the box around its regions, which stay near their
+   * source, so memory follows the distance, not the size of the map.
+   * Nothing is baked up front: update() bakes the sets around the camera,
+   * its own region's first, a few per call if asked, and cellChanged()
+   * sends the sets a change can affect back to waiting. A set waiting for
+   * its bake sees everything, so the sets stay conservative while they
+   * catch up.
+   */
+  class VisibleSets
+  {
+  public:
+    static const int REGION_SHIFT = 3;
+    static const int REGION = 1 << REGION_SHIFT;
+    static const int AROUND = 2; /* Regions around the camera's that update() bakes too */
+
+    VisibleSets(const WorldMap &map, double maxDistance);
+
+    void cellChanged(int x, int y);
+    int update(int x, int y, int maxSets = 0);
+
+    bool visible(int fromX, int fromY, int toX, int toY) const;
+    bool visibleArea(int fromX, int fromY, int x0, int y0, int x1, int y1) const;
+    size_t byteCount() const;
+
+  private:
+    struct Set
+    {
+      int x0, y0;               /* First region of the box */
+      int wide, high;           /* Regions in the box, 0 wide when nothing is seen */
+      std::vector<Uint64> bits; /* Bit (x - x0) * high + (y - y0) for a region seen */
+    };
+
+    /* The lines a ray stands for */
+    struct Beam
+    {
+      double offset; /* Furthest their start is from the ray's, along its edge */
+      double slope;  /* Tangent of the largest angle they make with the ray */
+
+      /* Furthest they are from the ray at a distance along it */
+      double width(double d) const { return offset + slope * (d + offset); }
+    };
+
+    void bake(int rx, int ry);
+    void trace(int rx, int ry, double x, double y, double dirX, double dirY, const Beam &beam);
+    void markLine(int rx, int ry, double x, double y, double dirX, double dirY, double end);
+    void markSlab(int rx, int ry, double x, double y, double dirX, double dirY, const Beam &beam, double from,
+                  double to);
+    bool walled(double x, double y, double alongX, double alongY, double width) const;
+    void mark(int rx, int ry, int x, int y);
+
+    const WorldMap &map;
+    double maxDistance;
+    int regionsWide, regionsHigh;
+    int reach;                 /* Regions a set can reach from its source, along each axis */
+    std::vector<Set> sets;     /* Set of region (rx, ry) at rx * regionsHigh + ry */
+    std::vector<bool> dirty;   /* Set of the region not baked, or changed since */
+    std::vector<Uint8> seen;   /* Regions marked by the bake in progress, around its source */
+  };
+}
+
+#endif // __THE_MAZE_VISIBLE_SETS_H__
@@ -0,0 +1,161 @@
+#include "world_map.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace maze
+{
+  /**
+   * WorldMap - an empty map
+   * @width: cells along x
+   * @height: cells along y
+   * @layout: how the cells are ordered in memory
+   */
+  WorldMap::WorldMap(int width, int height, Layout layout)
+      : mapWidth(width), mapHeight(height), layout(layout), tilesHigh((height + 7) / 8),
+        owned(cellCount(width, height, layout)), occupancy(width, height)
+  {
+    cells = &owned[0];
+  }
+
+  /**
+   * WorldMap - a map from an array of values, like the worldMap literal
+   * @values: the cells, values[x * height + y], each 0 to 255
+   * @width: cells along x
+   * @height: cells along y
+   * @layout: how the cells are ordered in memory
+   */
+  WorldMap::WorldMap(const int *values, int width, int height, Layout layout)
+      : mapWidth(width), mapHeight(height), layout(layout), tilesHigh((height + 7) / 8),
+        owned(cellCount(width, height, layout)), occupancy(width, height)
+  {
+    cells = &owned[0];
+    for (int x = 0; x < width; x++)
+      for (int y = 0; y < height; y++)
+        set(x, y, Uint8(values[size_t(x) * height + y]));
+  }
+
+  /**
+   * WorldMap - a map over layers kept elsewhere, changes go to them
+   * @width: cells along x
+   * @height: cells along y
+   * @layout: how the cells are ordered in memory
+   * @cells: cellCount() bytes
+   * @blocks: the occupancy blocks, already matching the cells
+   * @supers: the occupancy super-blocks, already matching the blocks
+   */
+  WorldMap::WorldMap(int width, int height, Layout layout, Uint8 *cells, Uint64 *blocks, Uint64 *supers)
+      : mapWidth(width), mapHeight(height), layout(layout), tilesHigh((height + 7) / 8), cells(cells),
+        occupancy(width, height, blocks, supers)
+  {
+  }
+
+  /**
+   * cellCount - bytes taken by the cells of a map
+   * @width: cells along x
+   * @height: cells along y
+   * @layout: how the cells are ordered
+   * Return: the count, tiles are padded to whole tiles
+   */
+  size_t WorldMap::cellCount(int width, int height, Layout layout)
+  {
+    if (layout == LAYOUT_LINEAR)
+      return size_t(width) * height;
+    return size_t((width + 7) / 8) * ((height + 7) / 8) * 64;
+  }
+
+  /**
+   * set - change a cell
+   * @x: cell x, inside the map
+   * @y: cell y, inside the map
+   * @value: 0 for empty, the texture slot + 1 for a wall
+   * Return: void
+   */
+  void WorldMap::set(int x, int y, Uint8 value)
+  {
+    cells[index(x, y)] = value;
+    occupancy.set(x, y, value > 0);
+  }
+
+  /**
+   * fill - set every cell to the same value
+   * @value: 0 for empty, the texture slot + 1 for a wall
+   * Return: void
+   */
+  void WorldMap::fill(Uint8 value)
+  {
+    std::fill(cells, cells + cellCount(mapWidth, mapHeight, layout), value);
+    occupancy.fill(value > 0);
+  }
+
+  /**
+   * writeRow - write() every cell of a row at once, in the order of the cells
+   * @x: cell x, inside the map
+   * @values: the value of every cell of the row, y from 0 to the height - 1
+   * Return: void
+   */
+  void WorldMap::writeRow(int x, const Uint8 *values)
+  {
+    if (layout == LAYOUT_LINEAR)
+    {
+      memcpy(cells + size_t(x) * mapHeight, values, mapHeight);
+      return;
+    }
+    /* 8 cells of the row in each tile along y */
+    Uint8 *tile = cells + index(x, 0);
+    int y = 0;
+    for (; y + 8 <= mapHeight; y += 8, tile += 64)
+      memcpy(tile, values + y, 8);
+    if (y < mapHeight)
+      memcpy(tile, values + y, mapHeight - y);
+  }
+
+  /**
+   * sync - rebuild the occupancy of every block from the cells, after
+   * changes made through write()
+   *
+   * A block of the tiled layout is one tile, its 64 bytes in the order of
+   * the block's bits.
+   * Return: void
+   */
+  void WorldMap::sync()
+  {
+    for (int bx = 0; bx < (mapWidth + 7) / 8; bx++)
+      for (int by = 0; by < tilesHigh; by++)
+      {
+        Uint64 bits = 0;
+        if (layout == LAYOUT_TILED)
+        {
+          const Uint8 *tile = cells + ((size_t(bx) * tilesHigh + by) << 6);
+#ifdef __SSE2__
+          /* 16 cells at a time, a bit for each byte that isn't 0 */
+          const __m128i zero = _mm_setzero_si128();
+          for (int k = 0; k < 4; k++)
+          {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(tile + 16 * k));
+            bits |= Uint64(~_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)) & 0xFFFF) << (16 * k);
+          }
+#else
+          for (int k = 0; k < 8; k++)
+          {
+            /* The 8 cells of x = bx * 8 + k as one word, the high bit of each nonzero byte, then those gathered into bits 0 to 7 */
+            Uint64 word = 0;
+            for (int i = 0; i < 8; i++)
+              word |= Uint64(tile[k * 8 + i]) << (i * 8);
+            word = (((word & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | word) & 0x8080808080808080ULL;
+            bits |= ((word >> 7) * 0x0102040810204080ULL) >> 56 << (k * 8);
+          }
+#endif
+        }
+        else
+          for (int x = bx * 8; x < bx * 8 + 8 && x < mapWidth; x++)
+            for (int y = by * 8; y < by * 8 + 8 && y < mapHeight; y++)
+              bits |= Uint64(cells[index(x, y)] != 0) << (((x & 7) << 3) | (y & 7));
+        occupancy.setBlock(bx, by, bits);
+      }
+  }
+}
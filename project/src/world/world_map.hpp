@@ -0,0 +1,99 @@
+/**
+ * @file world_map.hpp
+ * @brief Compact storage of the map cells.
+ * @author Jashon Osala
+ * @version 1.0
+ */
+
+#ifndef __THE_MAZE_WORLD_MAP_H__
+#define __THE_MAZE_WORLD_MAP_H__
+
+#include <vector>
+
+#include "../../../lib/quickcg.h"
+#include "occupancy_grid.hpp"
+
+namespace maze
+{
+  /**
+   * WorldMap - the cells of a map, sized at runtime.
+   *
+   * A cell is one byte: 0 for empty, v for a wall with texture slot v - 1.
+   * Next to the bytes, the occupancy grid holds a bit per cell, which is
+   * all the rays read until they hit something.
+   *
+   * The bytes are stored in 8x8 tiles by default, one 64-byte cache line
+   * each, so cells near each other in any direction share lines. The linear
+   * layout, x * height + y like worldMap[x][y], is the other choice.
+   *
+   * A map loaded from a map file uses the file's cells and occupancy words
+   * in place instead of copies.
+   */
+  class WorldMap
+  {
+  public:
+    enum Layout
+    {
+      LAYOUT_TILED,
+      LAYOUT_LINEAR
+    };
+
+    WorldMap(int width, int height, Layout layout = LAYOUT_TILED);
+    WorldMap(const int *cells, int width, int height, Layout layout = LAYOUT_TILED);
+    WorldMap(int width, int height, Layout layout, Uint8 *cells, Uint64 *blocks, Uint64 *supers);
+
+    static size_t cellCount(int width, int height, Layout layout);
+
+    int width() const { return mapWidth; }
+    int height() const { return mapHeight; }
+    bool inside(int x, int y) const { return x >= 0 && y >= 0 && x < mapWidth && y < mapHeight; }
+
+    /**
+     * at - the value of a cell
+     * @x: cell x, inside the map
+     * @y: cell y, inside the map
+     * Return: 0 for empty, the texture slot + 1 for a wall
+     */
+    Uint8 at(int x, int y) const { return cells[index(x, y)]; }
+    bool wall(int x, int y) const { return occupancy.wall(x, y); }
+    bool walkable(int x, int y) const { return inside(x, y) && !occupancy.wall(x, y); }
+    void set(int x, int y, Uint8 value);
+    void fill(Uint8 value);
+
+    /**
+     * write - change a cell but not its occupancy, for many changes at once:
+     * rays and walkable() don't see them until sync()
+     * @x: cell x, inside the map
+     * @y: cell y, inside the map
+     * @value: 0 for empty, the texture slot + 1 for a wall
+     * Return: void
+     */
+    void write(int x, int y, Uint8 value) { cells[index(x, y)] = value; }
+    void writeRow(int x, const Uint8 *values);
+    void sync();
+
+    const OccupancyGrid &grid() const { return occupancy; }
+    Layout cellLayout() const { return layout; }
+    const Uint8 *cellData() const { return cells; }
+
+  private:
+    WorldMap(const WorldMap &);
+    WorldMap &operator=(const WorldMap &);
+
+    size_t index(int x, int y) const
+    {
+      if (layout == LAYOUT_LINEAR)
+        return size_t(x) * mapHeight + y;
+      return (size_t(x >> 3) * tilesHigh + (y >> 3)) << 6 | (x & 7) << 3 | (y & 7);
+    }
+
+    int mapWidth, mapHeight;
+    Layout layout;
+    int tilesHigh;            /* Tiles along y */
+    Uint8 *cells;             /* One byte per cell, in the layout */
+    std::vector<Uint8> owned; /* The cells, unless they live elsewhere */
+    OccupancyGrid occupancy;  /* One bit per cell, and the empty blocks */
+  };
+}
+
+#endif // __THE_MAZE_WORLD_MAP_H__
@@ -0,0 +1,237 @@
+/**
+ * @file mapbake.cpp
+ * @brief Offline baker: turns a text map into a map file.
+ * @author Jashon Osala
+ * @version 1.0
+ *
+ * Usage: mapbake <out.map|out.chunks> <map.txt>
+ * An output ending in .chunks is a chunk file, streamed by the game a chunk
+ * at a time; chunk files keep no sprites. Their cells are written as they
+ * are read, a band of 64 rows at a time, so a world larger than memory can
+ * be baked from its text. A generated level is made whole in memory first,
+ * so it can't be larger than that, nor than 65536 cells a side.
+ * The text map is a list of lines, # starts a comment:
+ *   size <width> <height>
+ *   layout tiled|linear          optional, tiled by default
+ *   spawn <x> <y> <dirX> <dirY>   optional for generated maps
+ *   sprite <x> <y> <texture>     any number of them
+ *   cells                        followed by width rows of height values,
+ *                                row x holding cells (x, 0) to (x, height - 1)
+ * or, instead of the cells, a level made by MazeGenerator:
+ *   generate <algorithm> <seed> <wall>   backtracker, eller, rooms or caves,
+ *                                        walls of value <wall>
+ *   scatter <count> <texture>    that many sprites on random empty cells
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../lib/quickcg.h"
+#include "../project/src/world/chunked_world.hpp"
+#include "../project/src/world/map_file.hpp"
+#include "../project/src/world/maze_generator.hpp"
+
+using namespace maze;
+
+/**
+ * fail - report an error in the text map
+ * @path: the text map
+ * @message: what is wrong
+ * Return: 1, the exit status
+ */
+static int fail(const char *path, const std::string &message)
+{
+  std::cerr << path << ": " << message << std::endl;
+  return 1;
+}
+
+/**
+ * Words - the words of a text map, comments dropped, read a line at a time
+ *
+ * Read like a stream, and fails like one: on the first word missing or not
+ * of the type asked for, and from then on.
+ */
+class Words
+{
+public:
+  explicit Words(std::istream &in) : in(in), good(true) {}
+
+  template <class T>
+  Words &operator>>(T &value)
+  {
+    while (good && (line >> std::ws).eof())
+    {
+      std::string text;
+      good = bool(std::getline(in, text));
+      line.clear();
+      line.str(text.substr(0, text.find('#')));
+    }
+    good = good && (line >> value);
+    return *this;
+  }
+  operator const void *() const { return good ? this : 0; }
+
+private:
+  std::istream &in;
+  std::istringstream line;
+  bool good;
+};
+
+int main(int argc, char *argv[])
+{
+  if (argc != 3)
+  {
+    std::cerr << "usage: " << argv[0] << " <out.map|out.chunks> <map.txt>" << std::endl;
+    return 1;
+  }
+
+  std::ifstream in(argv[2]);
+  if (!in)
+    return fail(argv[2], "can't read");
+
+  std::string out = argv[1];
+  bool chunked = out.size() > 7 && out.compare(out.size() - 7, 7, ".chunks") == 0;
+  int maxSize = chunked ? 0x7fffffff : int(MAP_MAX_SIZE); /* Chunk files take any size */
+
+  /* Read as words, a line at a time; the cells of a chunk file go straight to it */
+  Words text(in);
+  ChunkWriter writer;
+
+  int width = 0, height = 0;
+  WorldMap::Layout layout = WorldMap::LAYOUT_TILED;
+  double spawn[4] = {0, 0, 0, 0};
+  bool spawned = false;
+  std::vector<MapSprite> sprites;
+  std::vector<Uint8> values; /* For a map file */
+  bool listed = false, generated = false;
+  MazeGenerator::Algorithm algorithm = MazeGenerator::BACKTRACKER;
+  unsigned long long seed = 0;
+  int wall = 1;
+  std::vector<std::pair<int, Uint32> > scatters; /* Count and texture */
+  std::string word;
+  while (text >> word)
+  {
+    if (word == "size")
+    {
+      if (!(text >> width >> height) || width < 1 || height < 1 || width > maxSize || height > maxSize)
+        return fail(argv[2], "bad size");
+    }
+    else if (word == "layout")
+    {
+      text >> word;
+      if (word != "tiled" && word != "linear")
+        return fail(argv[2], "layout is tiled or linear");
+      layout = word == "tiled" ? WorldMap::LAYOUT_TILED : WorldMap::LAYOUT_LINEAR;
+    }
+    else if (word == "spawn")
+    {
+      if (!(text >> spawn[0] >> spawn[1] >> spawn[2] >> spawn[3]))
+        return fail(argv[2], "bad spawn");
+      spawned = true;
+    }
+    else if (word == "sprite")
+    {
+      MapSprite sprite = {0, 0, 0, 0};
+      if (!(text >> sprite.x >> sprite.y >> sprite.texture))
+        return fail(argv[2], "bad sprite");
+      sprites.push_back(sprite);
+    }
+    else if (word == "cells")
+    {
+      if (!width)
+        return fail(argv[2], "cells before size");
+      if (listed)
+        return fail(argv[2], "cells twice");
+      if (chunked && !writer.open(out, width, height))
+        return fail(argv[1], "can't write");
+      std::vector<Uint8> row(height);
+      if (!chunked)
+        values.reserve(size_t(width) * height);
+      for (int x = 0; x < width; x++)
+      {
+        for (int y = 0; y < height; y++)
+        {
+          int value;
+          if (!(text >> value) || value < 0 || value > 255)
+            return fail(argv[2], "cells are width rows of height values from 0 to 255");
+          row[y] = Uint8(value);
+        }
+        if (chunked)
+          writer.writeRow(&row[0]);
+        else
+          values.insert(values.end(), row.begin(), row.end());
+      }
+      listed = true;
+    }
+    else if (word == "generate")
+    {
+      if (!(text >> word) || !MazeGenerator::parse(word, algorithm))
+        return fail(argv[2], "the algorithm is backtracker, eller, rooms or caves");
+      if (!(text >> seed >> wall) || wall < 1 || wall > 255)
+        return fail(argv[2], "generate takes an algorithm, a seed and a wall value from 1 to 255");
+      generated = true;
+    }
+    else if (word == "scatter")
+    {
+      std::pair<int, Uint32> scatter;
+      if (!(text >> scatter.first >> scatter.second) || scatter.first < 0)
+        return fail(argv[2], "bad scatter");
+      scatters.push_back(scatter);
+    }
+    else
+      return fail(argv[2], "unknown keyword " + word);
+  }
+  if (listed == generated)
+    return fail(argv[2], "either cells or generate");
+  if (!width)
+    return fail(argv[2], "no size");
+  if (!spawned && !generated)
+    return fail(argv[2], "no spawn");
+  if (generated && (width > int(MAP_MAX_SIZE) || height > int(MAP_MAX_SIZE)))
+    return fail(argv[2], "generated levels are made in memory, at most 65536 cells a side");
+  for (size_t i = 0; i < sprites.size(); i++)
+    if (!(sprites[i].x >= 0 && sprites[i].y >= 0 && sprites[i].x < width && sprites[i].y < height))
+      return fail(argv[2], "sprite outside the map");
+
+  if (listed && chunked)
+  {
+    /* Written already: finish it, then check the spawn in the file, the cells are nowhere else */
+    if (!writer.close(spawn[0], spawn[1], spawn[2], spawn[3]))
+      return fail(argv[1], "write failed");
+    ChunkedWorld world(4 * sizeof(Chunk));
+    if (!world.open(out) || !world.walkable(int(spawn[0]), int(spawn[1])))
+    {
+      world.close();
+      std::remove(out.c_str());
+      return fail(argv[2], "the spawn is not on an empty cell, looking somewhere");
+    }
+    std::cout << argv[1] << ": " << width << "x" << height << " cells, 0 sprites" << std::endl;
+    return 0;
+  }
+
+  WorldMap map(width, height, layout);
+  MazeGenerator generator(seed);
+  if (generated)
+    generator.generate(map, algorithm, Uint8(wall));
+  else
+    for (int x = 0; x < width; x++)
+      for (int y = 0; y < height; y++)
+        map.set(x, y, values[size_t(x) * height + y]);
+  for (size_t i = 0; i < scatters.size(); i++)
+    generator.scatter(map, scatters[i].first, scatters[i].second, sprites);
+  if (!spawned)
+    generator.spawn(map, spawn[0], spawn[1], spawn[2], spawn[3]);
+  /* The checks MapFile::open makes, so a bad map fails here instead of in the game */
+  if (spawn[0] < 0 || spawn[1] < 0 || !map.walkable(int(spawn[0]), int(spawn[1])) || (spawn[2] == 0 && spawn[3] == 0))
+    return fail(argv[2], "the spawn is not on an empty cell, looking somewhere");
+
+  if (chunked ? !ChunkedWorld::save(out, map, spawn[0], spawn[1], spawn[2], spawn[3])
+              : !MapFile::save(out, map, sprites.empty() ? 0 : &sprites[0], int(sprites.size()), spawn[0], spawn[1], spawn[2], spawn[3]))
+    return fail(argv[1], "write failed");
+  std::cout << argv[1] << ": " << width << "x" << height << " cells, " << (chunked ? 0 : sprites.size()) << " sprites" << std::endl;
+  return 0;
+}
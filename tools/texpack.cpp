@@ -0,0 +1,188 @@
+/**
+ * @file texpack.cpp
+ * @brief Offline packer: bakes PNG textures into a texture pack.
+ * @author Jashon Osala
+ * @version 1.0
+ *
+ * Usage: texpack <out.pak> <image.png>...
+ * Every image is stored with all its mip levels, each level both row-major
+ * and column-major. An image that quantizes to 8 bits within PALETTE_ERROR
+ * also gets that 8-bit copy, which the game uses instead when it runs with
+ * 8-bit textures. Images are named by the path given on the command line,
+ * which is the name the game looks them up with.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../lib/quickcg.h"
+#include "../project/src/textures/texture_pack.hpp"
+#include "../project/src/textures/texture_palette.hpp"
+
+using namespace maze;
+
+#define PALETTE_ERROR 2.0 // RMS error an 8-bit copy may have, the game's default
+
+/**
+ * downsample - next mip level, averaging 2x2 blocks per channel
+ * @src: the level to shrink, row-major
+ * @w: its width, set to the new width
+ * @h: its height, set to the new height
+ * Return: the new level, row-major
+ */
+static std::vector<Uint32> downsample(const std::vector<Uint32> &src, unsigned long &w, unsigned long &h)
+{
+  unsigned long nw = w > 1 ? w / 2 : 1, nh = h > 1 ? h / 2 : 1;
+  std::vector<Uint32> dst(nw * nh);
+  for (unsigned long y = 0; y < nh; y++)
+    for (unsigned long x = 0; x < nw; x++)
+    {
+      /* Odd sizes fold the last row or column into the block before it */
+      unsigned long x0 = x * 2, y0 = y * 2;
+      unsigned long x1 = (x0 + 1 < w) ? x0 + 1 : x0, y1 = (y0 + 1 < h) ? y0 + 1 : y0;
+      Uint32 p[4] = {src[y0 * w + x0], src[y0 * w + x1], src[y1 * w + x0], src[y1 * w + x1]};
+      Uint32 out = 0;
+      for (int shift = 0; shift < 32; shift += 8)
+      {
+        Uint32 sum = 2;
+        for (int i = 0; i < 4; i++)
+          sum += (p[i] >> shift) & 255;
+        out |= (sum / 4) << shift;
+      }
+      dst[y * nw + x] = out;
+    }
+  w = nw;
+  h = nh;
+  return dst;
+}
+
+/**
+ * transpose - column-major copy of a row-major image
+ * @src: the image
+ * @w: its width
+ * @h: its height
+ * Return: the copy, pixel (x, y) at x * h + y
+ */
+static std::vector<Uint32> transpose(const std::vector<Uint32> &src, unsigned long w, unsigned long h)
+{
+  std::vector<Uint32> dst(src.size());
+  for (unsigned long y = 0; y < h; y++)
+    for (unsigned long x = 0; x < w; x++)
+      dst[x * h + y] = src[y * w + x];
+  return dst;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    std::cerr << "usage: " << argv[0] << " <out.pak> <image.png>..." << std::endl;
+    return 1;
+  }
+
+  std::vector<QuickCG::ImageRequest> requests;
+  for (int i = 2; i < argc; i++)
+  {
+    bool repeated = false;
+    for (size_t j = 0; j < requests.size(); j++)
+      repeated = repeated || requests[j].filename == argv[i];
+    if (repeated)
+      continue;
+    if (strlen(argv[i]) >= size_t(PACK_NAME_SIZE))
+    {
+      std::cerr << argv[i] << ": name longer than " << PACK_NAME_SIZE - 1 << " characters" << std::endl;
+      return 1;
+    }
+    requests.push_back(QuickCG::ImageRequest(int(requests.size()), argv[i]));
+  }
+
+  std::vector<std::vector<Uint32> > images(requests.size());
+  if (QuickCG::loadImages(&images[0], requests))
+  {
+    for (size_t i = 0; i < requests.size(); i++)
+      if (requests[i].error)
+        std::cerr << requests[i].filename << ": error " << requests[i].error << std::endl;
+    return 1;
+  }
+
+  /* Bake every level of every image, in both layouts, and the 8-bit copy of the ones that quantize well */
+  std::vector<PackEntry> entries;
+  std::vector<std::vector<Uint32> > pixels;
+  for (size_t i = 0; i < requests.size(); i++)
+  {
+    unsigned long w = requests[i].w, h = requests[i].h;
+    std::vector<Uint32> level = images[i];
+    size_t first = entries.size();
+    for (Uint32 l = 0;; l++)
+    {
+      for (int layout = LAYOUT_ROWS; layout <= LAYOUT_COLUMNS; layout++)
+      {
+        PackEntry e;
+        memset(&e, 0, sizeof(e));
+        strncpy(e.name, requests[i].filename.c_str(), PACK_NAME_SIZE - 1);
+        e.width = Uint32(w);
+        e.height = Uint32(h);
+        e.level = l;
+        e.layout = Uint32(layout);
+        entries.push_back(e);
+        pixels.push_back(layout == LAYOUT_ROWS ? level : transpose(level, w, h));
+      }
+      if (w == 1 && h == 1)
+        break;
+      level = downsample(level, w, h);
+    }
+
+    PalettedTexture indexed;
+    double error;
+    if (!quantizeTexture(&images[i][0], images[i].size(), PALETTE_ERROR, indexed, &error))
+      std::cout << requests[i].filename << ": stays 32-bit, 8-bit would be off by " << error << " RMS" << std::endl;
+    else
+    {
+      PackEntry e = entries[first];
+      e.layout = LAYOUT_INDEXED;
+      entries.push_back(e);
+      std::vector<Uint32> data(256 + (indexed.indices.size() + 3) / 4, 0);
+      memcpy(&data[0], indexed.palette, sizeof(indexed.palette));
+      memcpy(&data[256], &indexed.indices[0], indexed.indices.size());
+      pixels.push_back(data);
+    }
+  }
+
+  /* Lay out the file: header, index, then aligned pixel data */
+  Uint64 offset = sizeof(PackHeader) + entries.size() * sizeof(PackEntry);
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    offset = (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+    entries[i].offset = offset;
+    offset += pixels[i].size() * sizeof(Uint32);
+  }
+
+  PackHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PACK_MAGIC, 8);
+  header.version = PACK_VERSION;
+  header.byteOrder = PACK_BYTE_ORDER;
+  header.count = Uint32(entries.size());
+  header.fileSize = offset;
+
+  std::vector<unsigned char> file(size_t(offset), 0);
+  memcpy(&file[0], &header, sizeof(header));
+  memcpy(&file[sizeof(header)], &entries[0], entries.size() * sizeof(PackEntry));
+  for (size_t i = 0; i < entries.size(); i++)
+    memcpy(&file[size_t(entries[i].offset)], &pixels[i][0], pixels[i].size() * sizeof(Uint32));
+
+  std::ofstream out(argv[1], std::ios::out | std::ios::binary);
+  out.write((const char *)&file[0], std::streamsize(file.size()));
+  if (!out.good())
+  {
+    std::cerr << argv[1] << ": write failed" << std::endl;
+    return 1;
+  }
+  std::cout << argv[1] << ": " << requests.size() << " images, " << entries.size() << " entries, "
+            << file.size() << " bytes" << std::endl;
+  return 0;
+}